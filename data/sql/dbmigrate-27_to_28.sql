@@ -0,0 +1,8 @@
+-- Script to migate from db version 27 to 28.
+-- Added the "binary" column to oplog, for ops stored in the OpCodec encoding
+--
+
+
+ALTER TABLE oplog ADD COLUMN binary BOOLEAN NOT NULL DEFAULT 'false';
+
+UPDATE settings SET v = '28' WHERE k == 'schema_version';
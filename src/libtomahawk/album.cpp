@@ -25,8 +25,12 @@
 #include "database/databasecommand_alltracks.h"
 #include "query.h"
 
+#include "utils/interncache.h"
 #include "utils/logger.h"
 
+// how many of the most recently used albums we keep around even if nobody else holds them
+#define ALBUM_CACHE_KEEPALIVE 4096
+
 using namespace Tomahawk;
 
 Album::Album() {}
@@ -46,20 +50,16 @@ Album::get( const Tomahawk::artist_ptr& artist, const QString& name, bool autoCr
 album_ptr
 Album::get( unsigned int id, const QString& name, const Tomahawk::artist_ptr& artist )
 {
-    static QHash< unsigned int, album_ptr > s_albums;
-    static QMutex s_mutex;
+    static TomahawkUtils::InternCache< unsigned int, Album > s_albums( "albums", ALBUM_CACHE_KEEPALIVE );
 
-    QMutexLocker lock( &s_mutex );
-    if ( s_albums.contains( id ) )
-    {
-        return s_albums.value( id );
-    }
+    if ( id == 0 )
+        return album_ptr( new Album( id, name, artist ) );
 
-    album_ptr a = album_ptr( new Album( id, name, artist ) );
-    if ( id > 0 )
-        s_albums.insert( id, a );
+    album_ptr a = s_albums.value( id );
+    if ( !a.isNull() )
+        return a;
 
-    return a;
+    return s_albums.insert( id, album_ptr( new Album( id, name, artist ) ) );
 }
 
 
@@ -69,6 +69,7 @@ Album::Album( unsigned int id, const QString& name, const Tomahawk::artist_ptr&
     , m_name( name )
     , m_artist( artist )
 {
+    m_sortname = DatabaseImpl::sortname( name );
 }
 
 
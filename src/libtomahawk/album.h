@@ -42,6 +42,7 @@ public:
 
     unsigned int id() const { return m_id; }
     QString name() const { return m_name; }
+    QString sortname() const { return m_sortname; }
     artist_ptr artist() const;
 
     Tomahawk::playlistinterface_ptr playlistInterface();
@@ -58,6 +59,7 @@ private:
 
     unsigned int m_id;
     QString m_name;
+    QString m_sortname;
 
     artist_ptr m_artist;
 
@@ -24,8 +24,12 @@
 #include "database/databaseimpl.h"
 #include "query.h"
 
+#include "utils/interncache.h"
 #include "utils/logger.h"
 
+// how many of the most recently used artists we keep around even if nobody else holds them
+#define ARTIST_CACHE_KEEPALIVE 4096
+
 using namespace Tomahawk;
 
 
@@ -53,20 +57,16 @@ Artist::get( const QString& name, bool autoCreate )
 artist_ptr
 Artist::get( unsigned int id, const QString& name )
 {
-    static QHash< unsigned int, artist_ptr > s_artists;
-    static QMutex s_mutex;
+    static TomahawkUtils::InternCache< unsigned int, Artist > s_artists( "artists", ARTIST_CACHE_KEEPALIVE );
 
-    QMutexLocker lock( &s_mutex );
-    if ( s_artists.contains( id ) )
-    {
-        return s_artists.value( id );
-    }
+    if ( id == 0 )
+        return artist_ptr( new Artist( id, name ) );
 
-    artist_ptr a = artist_ptr( new Artist( id, name ) );
-    if ( id > 0 )
-        s_artists.insert( id, a );
+    artist_ptr a = s_artists.value( id );
+    if ( !a.isNull() )
+        return a;
 
-    return a;
+    return s_artists.insert( id, artist_ptr( new Artist( id, name ) ) );
 }
 
 
@@ -90,35 +90,28 @@ Database::enqueue( const QSharedPointer<DatabaseCommand>& lc )
     }
     else
     {
-        // find existing amount of worker threads for commandname
-        // create new thread if < WORKER_THREADS
-        if ( m_workers.count() < m_maxConcurrentThreads )
-        {
-            DatabaseWorker* worker = new DatabaseWorker( m_impl, this, false );
-            worker->start();
-
-            m_workers << worker;
-        }
-
-        // find thread for commandname with lowest amount of outstanding jobs and enqueue job
-        int busyThreads = 0;
+        // find the worker with the least outstanding jobs
         DatabaseWorker* happyThread = 0;
         for ( int i = 0; i < m_workers.count(); i++ )
         {
             DatabaseWorker* worker = m_workers.at( i );
-
-            if ( !worker->busy() )
-            {
+            if ( !happyThread || worker->outstandingJobs() < happyThread->outstandingJobs() )
                 happyThread = worker;
+
+            if ( !happyThread->busy() )
                 break;
-            }
-            busyThreads++;
+        }
 
-            if ( !happyThread || worker->outstandingJobs() < happyThread->outstandingJobs() )
-                happyThread = worker;
+        // all of them are busy, spawn another one if we're allowed to
+        if ( ( !happyThread || happyThread->busy() ) && m_workers.count() < m_maxConcurrentThreads )
+        {
+            happyThread = new DatabaseWorker( m_impl, this, false );
+            happyThread->start();
+
+            m_workers << happyThread;
         }
 
-//        qDebug() << "Enqueueing command to thread:" << happyThread << busyThreads << lc->commandname();
+//        qDebug() << "Enqueueing command to thread:" << happyThread << happyThread->outstandingJobs() << lc->commandname();
         happyThread->enqueue( lc );
     }
 }
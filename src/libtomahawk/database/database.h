@@ -40,6 +40,8 @@ class DatabaseWorker;
     the queue of work. There is a threadpool responsible for exec'ing all
     the non-mutating (readonly) commands and one separate thread for mutating ones,
     so sqlite doesn't write to the Database from multiple threads.
+    Every readonly worker has its own sqlite connection (the db runs in WAL mode),
+    so they really do run concurrently with each other and with the writer.
 */
 class DLLEXPORT Database : public QObject
 {
@@ -55,6 +55,11 @@ DatabaseCommand_AddFiles::files() const
 void
 DatabaseCommand_AddFiles::postCommitHook()
 {
+    FuzzyIndex* index = Database::instance()->impl()->m_fuzzyIndex;
+    index->updateFields( "artist", m_indexArtists );
+    index->updateFields( "album", m_indexAlbums );
+    index->updateFields( "track", m_indexTracks );
+
     // make the collection object emit its tracksAdded signal, so the
     // collection browser will update/fade in etc.
     Collection* coll = source()->collection().data();
@@ -87,6 +92,9 @@ DatabaseCommand_AddFiles::exec( DatabaseImpl* dbi )
     QVariant srcid = source()->isLocal() ? QVariant( QVariant::Int ) : source()->id();
     qDebug() << "Adding" << m_files.length() << "files to db for source" << srcid;
 
+    // new or existing entries these files point at, to update the search index with
+    QMap< unsigned int, QString > artists, albums, tracks;
+
     QList<QVariant>::iterator it;
     for ( it = m_files.begin(); it != m_files.end(); ++it )
     {
@@ -147,11 +155,21 @@ DatabaseCommand_AddFiles::exec( DatabaseImpl* dbi )
         query_trackattr.bindValue( 2, year );
         query_trackattr.exec();
 
+        artists.insert( artistid, artist );
+        tracks.insert( trackid, track );
+        if ( albumid > 0 )
+            albums.insert( albumid, album );
+
         m_ids << fileid;
         added++;
     }
     qDebug() << "Inserted" << added << "tracks to database";
 
+    // the search index only learns about them once they're committed, see postCommitHook()
+    m_indexArtists = artists;
+    m_indexAlbums = albums;
+    m_indexTracks = tracks;
+
     if ( added )
         source()->updateIndexWhenSynced();
 
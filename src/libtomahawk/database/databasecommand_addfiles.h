@@ -20,6 +20,7 @@
 #define DATABASECOMMAND_ADDFILES_H
 
 #include <QObject>
+#include <QMap>
 #include <QVariantMap>
 
 #include "database/databasecommandloggable.h"
@@ -52,6 +53,8 @@ public:
 
     QVariantList files() const;
     void setFiles( const QVariantList& f ) { m_files = f; }
+    // takes over the files of another op of the same source, used when replaying ops in bulk
+    void merge( const DatabaseCommand_AddFiles& other ) { m_files << other.m_files; }
 
 signals:
     void done( const QList<QVariant>&, const Tomahawk::collection_ptr& );
@@ -60,6 +63,9 @@ signals:
 private:
     QVariantList m_files;
     QList<unsigned int> m_ids;
+
+    // entries these files point at, for the search index
+    QMap< unsigned int, QString > m_indexArtists, m_indexAlbums, m_indexTracks;
 };
 
 #endif // DATABASECOMMAND_ADDFILES_H
@@ -21,6 +21,7 @@
 #include <QSqlQuery>
 
 #include "databaseimpl.h"
+#include "resulthydrator.h"
 #include "artist.h"
 #include "album.h"
 #include "sourcelist.h"
@@ -52,6 +53,15 @@ DatabaseCommand_AllTracks::exec( DatabaseImpl* dbi )
             break;
     }
 
+    // the position is the artist sortname and file id of the last track of the previous page
+    QString pageToken;
+    if ( m_paginate )
+    {
+        m_orderToken = "artist.sortname, file.id";
+        if ( !m_pagePosition.isNull() )
+            pageToken = "AND ( artist.sortname > ? OR ( artist.sortname = ? AND file.id > ? ) )";
+    }
+
     if ( !m_collection.isNull() )
         sourceToken = QString( "AND file.source %1" ).arg( m_collection->source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( m_collection->source()->id() ) );
 
@@ -68,83 +78,60 @@ DatabaseCommand_AllTracks::exec( DatabaseImpl* dbi )
     }
 
     QString sql = QString(
-            "SELECT file.id, artist.name, album.name, track.name, file.size, "
-                   "file.duration, file.bitrate, file.url, file.source, file.mtime, file.mimetype, file_join.albumpos, artist.id, album.id, track.id "
+            "SELECT %1, file.id, artist.sortname "
             "FROM file, artist, track, file_join "
             "LEFT OUTER JOIN album "
             "ON file_join.album = album.id "
             "WHERE file.id = file_join.file "
             "AND file_join.artist = artist.id "
             "AND file_join.track = track.id "
-            "%1 "
-            "%2 %3 "
-            "%4 %5 %6"
-            ).arg( sourceToken )
+            "%2 "
+            "%3 %4 %5 "
+            "%6 %7 %8"
+            ).arg( ResultHydrator::columns() )
+             .arg( sourceToken )
              .arg( !m_artist ? QString() : QString( "AND artist.id = %1" ).arg( m_artist->id() ) )
              .arg( !m_album ? QString() : albumToken )
-             .arg( m_sortOrder > 0 ? QString( "ORDER BY %1" ).arg( m_orderToken ) : QString() )
-             .arg( m_sortDescending ? "DESC" : QString() )
+             .arg( pageToken )
+             .arg( !m_orderToken.isEmpty() ? QString( "ORDER BY %1" ).arg( m_orderToken ) : QString() )
+             .arg( m_sortDescending && !m_paginate ? "DESC" : QString() )
              .arg( m_amount > 0 ? QString( "LIMIT 0, %1" ).arg( m_amount ) : QString() );
 
     query.prepare( sql );
+    if ( !pageToken.isEmpty() )
+    {
+        const QVariantList position = m_pagePosition.toList();
+        query.addBindValue( position.value( 0 ) );
+        query.addBindValue( position.value( 0 ) );
+        query.addBindValue( position.value( 1 ) );
+    }
     query.exec();
 
+    ResultHydrator hydrator( dbi );
+    QList<Tomahawk::result_ptr> rl;
+    unsigned int rows = 0;
+    QVariantList lastPosition;
     while( query.next() )
     {
-        Tomahawk::source_ptr s;
-        QString url = query.value( 7 ).toString();
+        rows++;
+        lastPosition = QVariantList() << query.value( RESULT_COLUMNS + 1 ) << query.value( RESULT_COLUMNS );
 
-        if ( query.value( 8 ).toUInt() == 0 )
-        {
-            s = SourceList::instance()->getLocal();
-        }
-        else
+        Tomahawk::result_ptr result = hydrator.result( query );
+        if ( result.isNull() )
         {
-            s = SourceList::instance()->get( query.value( 8 ).toUInt() );
-            if ( s.isNull() )
-            {
-                Q_ASSERT( false );
-                continue;
-            }
-
-            url = QString( "servent://%1\t%2" ).arg( s->userName() ).arg( url );
+            Q_ASSERT( false );
+            continue;
         }
 
-        QString artist, track, album;
-        artist = query.value( 1 ).toString();
-        album = query.value( 2 ).toString();
-        track = query.value( 3 ).toString();
-
-        Tomahawk::result_ptr result = Tomahawk::Result::get( url );
-        Tomahawk::query_ptr qry = Tomahawk::Query::get( artist, track, album );
-        Tomahawk::artist_ptr artistptr = Tomahawk::Artist::get( query.value( 12 ).toUInt(), artist );
-        Tomahawk::album_ptr albumptr = Tomahawk::Album::get( query.value( 13 ).toUInt(), album, artistptr );
-
-        result->setTrackId( query.value( 14 ).toUInt() );
-        result->setArtist( artistptr );
-        result->setAlbum( albumptr );
-        result->setTrack( query.value( 3 ).toString() );
-        result->setSize( query.value( 4 ).toUInt() );
-        result->setDuration( query.value( 5 ).toUInt() );
-        result->setBitrate( query.value( 6 ).toUInt() );
-        result->setModificationTime( query.value( 9 ).toUInt() );
-        result->setMimetype( query.value( 10 ).toString() );
-        result->setAlbumPos( query.value( 11 ).toUInt() );
         result->setScore( 1.0 );
-        result->setCollection( s->collection() );
-
-        TomahawkSqlQuery attrQuery = dbi->newquery();
-        QVariantMap attr;
+        rl << result;
+    }
 
-        attrQuery.prepare( "SELECT k, v FROM track_attributes WHERE id = ?" );
-        attrQuery.bindValue( 0, result->trackId() );
-        attrQuery.exec();
-        while ( attrQuery.next() )
-        {
-            attr[ attrQuery.value( 0 ).toString() ] = attrQuery.value( 1 ).toString();
-        }
+    hydrator.loadAttributes();
 
-        result->setAttributes( attr );
+    foreach ( const Tomahawk::result_ptr& result, rl )
+    {
+        Tomahawk::query_ptr qry = Tomahawk::Query::get( result->artist()->name(), result->track(), result->album()->name() );
 
         QList<Tomahawk::result_ptr> results;
         results << result;
@@ -157,5 +144,10 @@ DatabaseCommand_AllTracks::exec( DatabaseImpl* dbi )
     qDebug() << Q_FUNC_INFO << ql.length();
 
     emit tracks( ql, data() );
+    if ( m_paginate )
+    {
+        // a short page means we're through
+        emit page( m_collection, ql, ( m_amount > 0 && rows == m_amount ) ? QVariant( lastPosition ) : QVariant() );
+    }
     emit done( m_collection );
 }
@@ -50,6 +50,7 @@ public:
         , m_amount( 0 )
         , m_sortOrder( DatabaseCommand_AllTracks::None )
         , m_sortDescending( false )
+        , m_paginate( false )
     {}
 
     virtual void exec( DatabaseImpl* );
@@ -64,9 +65,15 @@ public:
     void setSortOrder( DatabaseCommand_AllTracks::SortOrder order ) { m_sortOrder = order; }
     void setSortDescending( bool descending ) { m_sortDescending = descending; }
 
+    /// keyset pagination, ordered by artist: fetches the next page of setLimit() tracks after position.
+    /// position is what page() handed out for the previous page, or a null QVariant for the first one
+    void setPage( const QVariant& position ) { m_paginate = true; m_pagePosition = position; }
+
 signals:
     void tracks( const QList<Tomahawk::query_ptr>&, const QVariant& data );
     void done( const Tomahawk::collection_ptr& );
+    /// only emitted when paginating. nextPosition is null if this was the last page
+    void page( const Tomahawk::collection_ptr& collection, const QList<Tomahawk::query_ptr>& tracks, const QVariant& nextPosition );
 
 private:
     Tomahawk::collection_ptr m_collection;
@@ -77,6 +84,9 @@ private:
     unsigned int m_amount;
     DatabaseCommand_AllTracks::SortOrder m_sortOrder;
     bool m_sortDescending;
+
+    bool m_paginate;
+    QVariant m_pagePosition;
 };
 
 #endif // DATABASECOMMAND_ALLTRACKS_H
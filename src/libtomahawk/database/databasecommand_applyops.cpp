@@ -0,0 +1,105 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "databasecommand_applyops.h"
+
+#include "databasecommand_addfiles.h"
+#include "databasecommand_deletefiles.h"
+#include "databaseimpl.h"
+#include "source.h"
+#include "utils/logger.h"
+
+
+DatabaseCommand_ApplyOps::DatabaseCommand_ApplyOps( const QList< QSharedPointer<DatabaseCommand> >& ops, const Tomahawk::source_ptr& source, QObject* parent )
+    : DatabaseCommand( source, parent )
+    , m_opCount( ops.count() )
+{
+    foreach ( const QSharedPointer<DatabaseCommand>& op, ops )
+    {
+        // same as DatabaseWorker does for single ops: singletons don't move the lastop marker
+        if ( op->loggable() && !op->singletonCmd() )
+            m_lastGuid = op->guid();
+    }
+
+    merge( ops );
+}
+
+
+void
+DatabaseCommand_ApplyOps::merge( const QList< QSharedPointer<DatabaseCommand> >& ops )
+{
+    foreach ( const QSharedPointer<DatabaseCommand>& op, ops )
+    {
+        if ( !m_commands.isEmpty() && m_commands.last()->commandname() == op->commandname() )
+        {
+            const QSharedPointer<DatabaseCommand>& last = m_commands.last();
+
+            if ( op->commandname() == "addfiles" )
+            {
+                qobject_cast< DatabaseCommand_AddFiles* >( last.data() )->merge( *qobject_cast< DatabaseCommand_AddFiles* >( op.data() ) );
+                continue;
+            }
+
+            DatabaseCommand_DeleteFiles* lastDelete = qobject_cast< DatabaseCommand_DeleteFiles* >( last.data() );
+            DatabaseCommand_DeleteFiles* opDelete = qobject_cast< DatabaseCommand_DeleteFiles* >( op.data() );
+            if ( lastDelete && opDelete && !lastDelete->deleteAll() && !opDelete->deleteAll() )
+            {
+                lastDelete->merge( *opDelete );
+                continue;
+            }
+        }
+
+        m_commands << op;
+    }
+}
+
+
+void
+DatabaseCommand_ApplyOps::exec( DatabaseImpl* lib )
+{
+    tDebug() << "Applying" << m_opCount << "ops as" << m_commands.count() << "commands for source" << source()->id();
+
+    foreach ( const QSharedPointer<DatabaseCommand>& cmd, m_commands )
+        cmd->_exec( lib );
+
+    if ( m_lastGuid.isEmpty() )
+        return;
+
+    // Make a note of the last guid we applied for this source
+    // so we can always request just the newer ops in future.
+    TomahawkSqlQuery query = lib->newquery();
+    query.prepare( "UPDATE source SET lastop = ? WHERE id = ?" );
+    query.addBindValue( m_lastGuid );
+    query.addBindValue( source()->id() );
+
+    if ( !query.exec() )
+    {
+        throw "Failed to set lastop";
+    }
+}
+
+
+void
+DatabaseCommand_ApplyOps::postCommitHook()
+{
+    foreach ( const QSharedPointer<DatabaseCommand>& cmd, m_commands )
+        cmd->postCommit();
+
+    foreach ( const QSharedPointer<DatabaseCommand>& cmd, m_commands )
+        cmd->emitFinished();
+}
@@ -0,0 +1,60 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATABASECOMMAND_APPLYOPS_H
+#define DATABASECOMMAND_APPLYOPS_H
+
+#include <QList>
+#include <QSharedPointer>
+
+#include "databasecommand.h"
+#include "typedefs.h"
+
+#include "dllmacro.h"
+
+/*
+    Applies a batch of ops we received from a peer in one go: consecutive
+    AddFiles / DeleteFiles ops are merged into a single command each, all of
+    them run in the same transaction and the source's lastop is only updated
+    once, at the end. If any op fails the whole batch is rolled back and
+    lastop keeps its old value; Source then forgets its in-memory guid, so
+    the next sync asks the peer for everything since the stored lastop.
+*/
+class DLLEXPORT DatabaseCommand_ApplyOps : public DatabaseCommand
+{
+Q_OBJECT
+
+public:
+    explicit DatabaseCommand_ApplyOps( const QList< QSharedPointer<DatabaseCommand> >& ops, const Tomahawk::source_ptr& source, QObject* parent = 0 );
+
+    virtual QString commandname() const { return "applyops"; }
+    virtual bool doesMutates() const { return true; }
+    virtual bool localOnly() const { return true; }
+
+    virtual void exec( DatabaseImpl* lib );
+    virtual void postCommitHook();
+
+private:
+    void merge( const QList< QSharedPointer<DatabaseCommand> >& ops );
+
+    QList< QSharedPointer<DatabaseCommand> > m_commands;
+    QString m_lastGuid;
+    int m_opCount;
+};
+
+#endif // DATABASECOMMAND_APPLYOPS_H
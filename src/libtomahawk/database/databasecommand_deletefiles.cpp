@@ -37,6 +37,10 @@ using namespace Tomahawk;
 void
 DatabaseCommand_DeleteFiles::postCommitHook()
 {
+    QHash< QString, QList< unsigned int > >::const_iterator it = m_orphans.constBegin();
+    for ( ; it != m_orphans.constEnd(); ++it )
+        Database::instance()->impl()->m_fuzzyIndex->deleteFields( it.key(), it.value() );
+
     if ( !m_idList.count() )
         return;
 
@@ -97,11 +101,11 @@ DatabaseCommand_DeleteFiles::exec( DatabaseImpl* dbi )
         }
     }
 
+    QString fileCondition;
     if ( m_deleteAll )
     {
-        delquery.prepare( QString( "DELETE FROM file WHERE source %1" )
-                    .arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) ) );
-        delquery.exec();
+        fileCondition = QString( "source %1" )
+                           .arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) );
     }
     else if ( !m_ids.isEmpty() )
     {
@@ -115,6 +119,7 @@ DatabaseCommand_DeleteFiles::exec( DatabaseImpl* dbi )
             delquery.prepare( QString( "SELECT id FROM file WHERE source = %1 AND url IN ( %2 )" )
                         .arg( source()->id() )
                         .arg( idstring ) );
+            delquery.exec();
 
             idstring = QString();
             while ( delquery.next() )
@@ -125,11 +130,36 @@ DatabaseCommand_DeleteFiles::exec( DatabaseImpl* dbi )
             idstring.chop( 2 ); //remove the trailing ", "
         }
 
-        delquery.prepare( QString( "DELETE FROM file WHERE source %1 AND id IN ( %2 )" )
-                             .arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) )
-                             .arg( idstring ) );
+        if ( !idstring.isEmpty() )
+        {
+            fileCondition = QString( "source %1 AND id IN ( %2 )" )
+                               .arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) )
+                               .arg( idstring );
+        }
+    }
 
+    if ( !fileCondition.isEmpty() )
+    {
+        // remember what the files pointed to, so we can drop orphans from the search index afterwards
+        QSet< unsigned int > artists, albums, tracks;
+        TomahawkSqlQuery joinquery = dbi->newquery();
+        joinquery.prepare( QString( "SELECT DISTINCT artist, album, track FROM file_join WHERE file IN ( SELECT id FROM file WHERE %1 )" )
+                              .arg( fileCondition ) );
+        joinquery.exec();
+        while ( joinquery.next() )
+        {
+            artists << joinquery.value( 0 ).toUInt();
+            if ( !joinquery.value( 1 ).isNull() )
+                albums << joinquery.value( 1 ).toUInt();
+            tracks << joinquery.value( 2 ).toUInt();
+        }
+
+        delquery.prepare( QString( "DELETE FROM file WHERE %1" ).arg( fileCondition ) );
         delquery.exec();
+
+        removeOrphansFromIndex( dbi, "artist", artists );
+        removeOrphansFromIndex( dbi, "album", albums );
+        removeOrphansFromIndex( dbi, "track", tracks );
     }
 
     if ( m_idList.count() )
@@ -137,3 +167,33 @@ DatabaseCommand_DeleteFiles::exec( DatabaseImpl* dbi )
 
     emit done( m_idList, source()->collection() );
 }
+
+
+void
+DatabaseCommand_DeleteFiles::removeOrphansFromIndex( DatabaseImpl* dbi, const QString& table, const QSet< unsigned int >& ids )
+{
+    if ( ids.isEmpty() )
+        return;
+
+    QStringList idsl;
+    foreach ( unsigned int id, ids )
+        idsl << QString::number( id );
+
+    // the rows stay in the database, but without any files left there's nothing to resolve them to
+    TomahawkSqlQuery query = dbi->newquery();
+    query.prepare( QString( "SELECT id FROM %1 WHERE id IN ( %2 ) AND NOT EXISTS "
+                            "( SELECT 1 FROM file_join WHERE file_join.%1 = %1.id )" )
+                      .arg( table )
+                      .arg( idsl.join( ", " ) ) );
+    query.exec();
+
+    QList< unsigned int > orphans;
+    while ( query.next() )
+        orphans << query.value( 0 ).toUInt();
+
+    // the search index only drops them once we're committed, see postCommitHook()
+    m_orphans[ table ] << orphans;
+
+    IdCache::Table t = ( table == "artist" ? IdCache::Artist : ( table == "album" ? IdCache::Album : IdCache::Track ) );
+    dbi->idCache().forget( t, orphans );
+}
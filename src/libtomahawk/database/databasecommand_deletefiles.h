@@ -21,6 +21,8 @@
 
 #include <QObject>
 #include <QDir>
+#include <QHash>
+#include <QSet>
 #include <QVariantMap>
 
 #include "database/databasecommandloggable.h"
@@ -72,16 +74,23 @@ public:
 
     bool deleteAll() const { return m_deleteAll; }
     void setDeleteAll( const bool deleteAll ) { m_deleteAll = deleteAll; }
+    // takes over the ids of another op of the same source, used when replaying ops in bulk
+    void merge( const DatabaseCommand_DeleteFiles& other ) { m_ids << other.m_ids; }
 
 signals:
     void done( const QList<unsigned int>&, const Tomahawk::collection_ptr& );
     void notify( const QList<unsigned int>& ids );
 
 private:
+    void removeOrphansFromIndex( DatabaseImpl* dbi, const QString& table, const QSet< unsigned int >& ids );
+
     QDir m_dir;
     QVariantList m_ids;
     QList<unsigned int> m_idList;
     bool m_deleteAll;
+
+    // table -> entries left without any files, for the search index
+    QHash< QString, QList< unsigned int > > m_orphans;
 };
 
 #endif // DATABASECOMMAND_DELETEFILES_H
@@ -47,14 +47,17 @@ DatabaseCommand_loadOps::exec( DatabaseImpl* dbi )
 
     TomahawkSqlQuery query = dbi->newquery();
     query.prepare( QString(
-                   "SELECT guid, command, json, compressed, singleton "
+                   "SELECT guid, command, json, compressed, singleton, binary "
                    "FROM oplog "
                    "WHERE source %1 "
                    "AND id > coalesce((SELECT id FROM oplog WHERE guid = ?),0) "
-                   "ORDER BY id ASC"
+                   "ORDER BY id ASC %2"
                    ).arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) )
+                    .arg( m_limit ? "LIMIT ?" : "" )
                   );
     query.addBindValue( m_since );
+    if ( m_limit )
+        query.addBindValue( m_limit );
     query.exec();
 
     QString lastguid = m_since;
@@ -66,6 +69,7 @@ DatabaseCommand_loadOps::exec( DatabaseImpl* dbi )
         op->payload = query.value( 2 ).toByteArray();
         op->compressed = query.value( 3 ).toBool();
         op->singleton = query.value( 4 ).toBool();
+        op->binary = query.value( 5 ).toBool();
 
         lastguid = op->guid;
         ops << op;
@@ -29,8 +29,9 @@ class DLLEXPORT DatabaseCommand_loadOps : public DatabaseCommand
 {
 Q_OBJECT
 public:
-    explicit DatabaseCommand_loadOps( const Tomahawk::source_ptr& src, QString since, QObject* parent = 0 )
-        : DatabaseCommand( src ), m_since( since )
+    // loads at most limit ops after since, or all of them if limit is 0
+    explicit DatabaseCommand_loadOps( const Tomahawk::source_ptr& src, QString since, unsigned int limit = 0, QObject* parent = 0 )
+        : DatabaseCommand( src ), m_since( since ), m_limit( limit )
     {
         Q_UNUSED( parent );
     }
@@ -44,6 +45,7 @@ signals:
 
 private:
     QString m_since; // guid to load from
+    unsigned int m_limit;
 };
 
 #endif // DATABASECOMMAND_LOADOPS_H
@@ -0,0 +1,309 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "databasecommand_loadsnapshot.h"
+
+#include <qjson/parser.h>
+#include <qjson/qobjecthelper.h>
+
+#include "databasecommand_addfiles.h"
+#include "databasecommand_deletefiles.h"
+#include "databaseimpl.h"
+#include "opcodec.h"
+#include "tomahawksqlquery.h"
+#include "network/msgcodec.h"
+#include "network/msg.h"
+#include "source.h"
+#include "utils/logger.h"
+
+// how many files go into a single addfiles op of the snapshot
+#define FILES_PER_OP 1000
+// "snapshot/<latest guid>/<its oplog id>/<highest file id>/<h or f><last oplog or file id sent>"
+#define SNAPSHOT_GUID_PREFIX "snapshot/"
+
+
+static QString
+snapshotGuid( const QString& lastguid, int lastOpId, int maxFileId, char phase, int position )
+{
+    return QString( SNAPSHOT_GUID_PREFIX "%1/%2/%3/%4%5" ).arg( lastguid ).arg( lastOpId ).arg( maxFileId ).arg( phase ).arg( position );
+}
+
+
+bool
+DatabaseCommand_LoadSnapshot::isSnapshotGuid( const QString& guid )
+{
+    return guid.startsWith( SNAPSHOT_GUID_PREFIX );
+}
+
+
+void
+DatabaseCommand_LoadSnapshot::exec( DatabaseImpl* dbi )
+{
+    Q_ASSERT( source()->isLocal() );
+    Q_ASSERT( m_limit );
+
+    const int limit = m_limit;
+    QList< dbop_ptr > ops;
+
+    QString lastguid;
+    int lastOpId = 0;
+    int maxFileId = 0;
+    // 'h' while sending the oplog history, 'f' once the deletefiles op went out
+    char phase = 'h';
+    int position = 0;
+
+    if ( isSnapshotGuid( m_since ) )
+    {
+        const QStringList parts = m_since.mid( QString( SNAPSHOT_GUID_PREFIX ).length() ).split( '/' );
+        if ( parts.count() != 4 || parts.at( 3 ).length() < 2 )
+        {
+            tLog() << "Invalid snapshot guid requested, not replying:" << m_since;
+            Q_ASSERT( false );
+            emit done( m_since, m_since, ops );
+            return;
+        }
+
+        lastguid = parts.at( 0 );
+        lastOpId = parts.at( 1 ).toInt();
+        maxFileId = parts.at( 2 ).toInt();
+        phase = parts.at( 3 ).at( 0 ).toLatin1();
+        position = parts.at( 3 ).mid( 1 ).toInt();
+    }
+
+    // the guid, the ops and the files have to match up, so read them all from the same snapshot
+    const bool readTransaction = dbi->hasThreadConnection() && dbi->database().transaction();
+
+    TomahawkSqlQuery query = dbi->newquery();
+
+    if ( lastguid.isEmpty() )
+    {
+        query.exec( "SELECT id, guid FROM oplog WHERE source IS NULL ORDER BY id DESC LIMIT 1" );
+        if ( !query.next() )
+        {
+            // nothing happened yet, nothing to send
+            if ( readTransaction )
+                dbi->database().commit();
+
+            emit done( m_since, QString(), ops );
+            return;
+        }
+
+        lastOpId = query.value( 0 ).toInt();
+        lastguid = query.value( 1 ).toString();
+
+        // files added later on reach the peer through the oplog, after lastguid
+        query.exec( "SELECT coalesce( max( id ), 0 ) FROM file WHERE source IS NULL" );
+        if ( query.next() )
+            maxFileId = query.value( 0 ).toInt();
+    }
+
+    if ( phase == 'h' )
+    {
+        // playlists etc. can't be reconstructed from their current state, so they still get their full history
+        query.prepare( "SELECT id, guid, command, json, compressed, singleton, binary "
+                       "FROM oplog "
+                       "WHERE source IS NULL "
+                       "AND id > ? AND id <= ? "
+                       "AND command NOT IN ( 'addfiles', 'deletefiles' ) "
+                       "ORDER BY id ASC LIMIT ?" );
+        query.addBindValue( position );
+        query.addBindValue( lastOpId );
+        // one more than fits, to know if there's anything left
+        query.addBindValue( limit + 1 );
+        query.exec();
+
+        // counting rows, not ops: skipped ones still mean there may be more
+        int rows = 0;
+        bool more = false;
+        while ( query.next() )
+        {
+            if ( rows++ == limit )
+            {
+                more = true;
+                break;
+            }
+
+            dbop_ptr op( new DBOp );
+            op->guid = query.value( 1 ).toString();
+            op->command = query.value( 2 ).toString();
+            op->payload = query.value( 3 ).toByteArray();
+            op->compressed = query.value( 4 ).toBool();
+            op->singleton = query.value( 5 ).toBool();
+            op->binary = query.value( 6 ).toBool();
+
+            // the peer takes the guid from the payload, it has to point back into the snapshot as well
+            if ( retag( op, snapshotGuid( lastguid, lastOpId, maxFileId, 'h', query.value( 0 ).toInt() ) ) )
+                ops << op;
+        }
+
+        if ( !more && ops.count() < limit )
+        {
+            DatabaseCommand_DeleteFiles cmd( source() );
+            cmd.setGuid( snapshotGuid( lastguid, lastOpId, maxFileId, 'f', 0 ) );
+            ops << serialize( &cmd );
+
+            phase = 'f';
+            position = 0;
+        }
+    }
+
+    bool complete = false;
+    if ( phase == 'f' )
+    {
+        query.prepare( "SELECT file.id, mtime, size, md5, mimetype, duration, bitrate, "
+                       "artist.name, album.name, track.name, file_join.albumpos, "
+                       "( SELECT v FROM track_attributes WHERE track_attributes.id = file_join.track AND k = 'releaseyear' ) "
+                       "FROM file, file_join, artist, track "
+                       "LEFT JOIN album ON album.id = file_join.album "
+                       "WHERE file.source IS NULL "
+                       "AND file.id > ? AND file.id <= ? "
+                       "AND file_join.file = file.id "
+                       "AND artist.id = file_join.artist "
+                       "AND track.id = file_join.track "
+                       "ORDER BY file.id ASC LIMIT ?" );
+        query.addBindValue( position );
+        query.addBindValue( maxFileId );
+        query.addBindValue( ( limit - ops.count() ) * FILES_PER_OP + 1 );
+        query.exec();
+
+        complete = true;
+        QVariantList files;
+        while ( query.next() )
+        {
+            if ( ops.count() == limit )
+            {
+                complete = false;
+                break;
+            }
+
+            QVariantMap m;
+            m["id"]       = query.value( 0 ).toInt();
+            m["mtime"]    = query.value( 1 ).toInt();
+            m["size"]     = query.value( 2 ).toUInt();
+            m["hash"]     = query.value( 3 ).toString();
+            m["mimetype"] = query.value( 4 ).toString();
+            m["duration"] = query.value( 5 ).toUInt();
+            m["bitrate"]  = query.value( 6 ).toUInt();
+            m["artist"]   = query.value( 7 ).toString();
+            m["album"]    = query.value( 8 ).toString();
+            m["track"]    = query.value( 9 ).toString();
+            m["albumpos"] = query.value( 10 ).toUInt();
+            m["year"]     = query.value( 11 ).toInt();
+            files << m;
+
+            if ( files.count() == FILES_PER_OP )
+            {
+                DatabaseCommand_AddFiles cmd( files, source() );
+                cmd.setGuid( snapshotGuid( lastguid, lastOpId, maxFileId, 'f', m["id"].toInt() ) );
+                ops << serialize( &cmd );
+                files.clear();
+            }
+        }
+
+        if ( !files.isEmpty() )
+        {
+            DatabaseCommand_AddFiles cmd( files, source() );
+            cmd.setGuid( snapshotGuid( lastguid, lastOpId, maxFileId, 'f', files.last().toMap().value( "id" ).toInt() ) );
+            ops << serialize( &cmd );
+        }
+    }
+
+    if ( readTransaction )
+        dbi->database().commit();
+
+    if ( complete )
+    {
+        // the files we'd have continued with got deleted in the meantime, we still need an op to hand over lastguid
+        if ( ops.isEmpty() )
+        {
+            DatabaseCommand_AddFiles cmd( QVariantList(), source() );
+            cmd.setGuid( lastguid );
+            ops << serialize( &cmd );
+        }
+
+        // the peer continues with regular fetchops from the guid of the last op we send
+        if ( ops.last()->guid != lastguid )
+            retag( ops.last(), lastguid );
+    }
+
+    tLog() << "Loaded collection snapshot page up to" << ops.last()->guid << "-" << ops.count() << "ops";
+    emit done( m_since, ops.last()->guid, ops );
+}
+
+
+dbop_ptr
+DatabaseCommand_LoadSnapshot::serialize( DatabaseCommandLoggable* command )
+{
+    dbop_ptr op( new DBOp );
+    op->command = command->commandname();
+    op->singleton = command->singletonCmd();
+    encode( op, QJson::QObjectHelper::qobject2qvariant( command ) );
+
+    return op;
+}
+
+
+bool
+DatabaseCommand_LoadSnapshot::retag( const dbop_ptr& op, const QString& guid )
+{
+    const QByteArray payload = op->compressed ? qUncompress( op->payload ) : op->payload;
+
+    QVariant variant;
+    if ( op->binary )
+    {
+        variant = OpCodec::decode( payload );
+    }
+    else
+    {
+        QJson::Parser parser;
+        bool ok;
+        variant = parser.parse( payload, &ok );
+    }
+
+    if ( variant.type() != QVariant::Map )
+    {
+        // the peer couldn't do anything with it either
+        tLog() << "Failed to decode op" << op->guid << "for the snapshot, skipping it";
+        Q_ASSERT( false );
+        return false;
+    }
+
+    QVariantMap m = variant.toMap();
+    m["guid"] = guid;
+    encode( op, m );
+    return true;
+}
+
+
+void
+DatabaseCommand_LoadSnapshot::encode( const dbop_ptr& op, const QVariantMap& variant )
+{
+    // same as DatabaseWorker::logOp does when saving to the oplog
+    QByteArray ba = OpCodec::encode( variant );
+
+    op->guid = variant.value( "guid" ).toString();
+    op->compressed = false;
+    op->binary = true;
+
+    if ( ba.length() >= 512 )
+    {
+        ba = qCompress( ba, MsgCodec::levelFor( Msg::DBOP ) );
+        op->compressed = true;
+    }
+    op->payload = ba;
+}
@@ -0,0 +1,78 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATABASECOMMAND_LOADSNAPSHOT_H
+#define DATABASECOMMAND_LOADSNAPSHOT_H
+
+#include "typedefs.h"
+#include "databasecommand.h"
+#include "op.h"
+
+#include "dllmacro.h"
+
+class DatabaseCommandLoggable;
+
+/*
+    Builds the ops a peer needs to get a copy of our collection without
+    replaying our whole oplog: every op that isn't about files, followed by
+    a deletefiles op clearing their copy and the current state of our
+    collection as addfiles ops.
+
+    Like loadops it only returns a page of at most limit ops at a time. Every
+    op but the very last is tagged with a made up snapshot guid saying where
+    we left off, so when the peer asks for more with it we continue from
+    there, see isSnapshotGuid(). That stays consistent across pages as only
+    oplog entries and files from when the snapshot was started get sent:
+    neither changes afterwards, anything that happens later is in the oplog.
+
+    The last op carries the guid of our latest oplog entry at that time, so
+    the peer continues with regular fetchops requests from there.
+*/
+class DLLEXPORT DatabaseCommand_LoadSnapshot : public DatabaseCommand
+{
+Q_OBJECT
+public:
+    // since is empty for a new snapshot, or the snapshot guid of the last op the peer got
+    explicit DatabaseCommand_LoadSnapshot( const Tomahawk::source_ptr& src, const QString& since, unsigned int limit, QObject* parent = 0 )
+        : DatabaseCommand( src, parent )
+        , m_since( since )
+        , m_limit( limit )
+    {}
+
+    virtual void exec( DatabaseImpl* db );
+    virtual bool doesMutates() const { return false; }
+    virtual QString commandname() const { return "loadsnapshot"; }
+
+    // whether a lastop a peer sent us points into the middle of a snapshot
+    static bool isSnapshotGuid( const QString& guid );
+
+signals:
+    // same as DatabaseCommand_loadOps::done
+    void done( QString sinceguid, QString lastguid, QList< dbop_ptr > ops );
+
+private:
+    dbop_ptr serialize( DatabaseCommandLoggable* command );
+    // sets the guid inside the op's payload, which is what the peer goes by
+    bool retag( const dbop_ptr& op, const QString& guid );
+    void encode( const dbop_ptr& op, const QVariantMap& variant );
+
+    QString m_since;
+    unsigned int m_limit;
+};
+
+#endif // DATABASECOMMAND_LOADSNAPSHOT_H
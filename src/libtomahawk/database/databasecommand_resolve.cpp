@@ -17,15 +17,33 @@
  */
 
 #include "databasecommand_resolve.h"
+#include "resulthydrator.h"
 
 #include "artist.h"
 #include "album.h"
 #include "sourcelist.h"
 #include "utils/logger.h"
 
+// how many artists / albums a full-text search returns at most
+#define FTS_MAX_MATCHES 20
+// how many files a full-text search returns at most
+#define FTS_MAX_RESULTS 100
+
 using namespace Tomahawk;
 
 
+// exact matches first, then the closer the name is to what we searched for the better
+static float
+ftsScore( const QString& sortname, const QString& name )
+{
+    const QString s = DatabaseImpl::sortname( name );
+    if ( s == sortname )
+        return 1.0;
+
+    return qMin( (float)0.99, (float)sortname.length() / qMax( 1, s.length() ) );
+}
+
+
 DatabaseCommand_Resolve::DatabaseCommand_Resolve( const query_ptr& query )
     : DatabaseCommand()
     , m_query( query )
@@ -62,7 +80,9 @@ DatabaseCommand_Resolve::exec( DatabaseImpl* lib )
         }
     }
 
-    if ( m_query->isFullTextQuery() )
+    if ( m_query->isFullTextQuery() && lib->hasFullTextIndex() )
+        ftsResolve( lib );
+    else if ( m_query->isFullTextQuery() )
         fullTextResolve( lib );
     else
         resolve( lib );
@@ -99,81 +119,34 @@ DatabaseCommand_Resolve::resolve( DatabaseImpl* lib )
     QString artsToken = QString( "file_join.artist IN (%1)" ).arg( artsl.join( "," ) );
     QString trksToken = QString( "file_join.track IN (%1)" ).arg( trksl.join( "," ) );
 
-    QString sql = QString( "SELECT "
-                            "url, mtime, size, md5, mimetype, duration, bitrate, file_join.artist, file_join.album, file_join.track, "
-                            "artist.name as artname, "
-                            "album.name as albname, "
-                            "track.name as trkname, "
-                            "file.source, "
-                            "file_join.albumpos, "
-                            "artist.id as artid, "
-                            "album.id as albid "
+    QString sql = QString( "SELECT %1 "
                             "FROM file, file_join, artist, track "
                             "LEFT JOIN album ON album.id = file_join.album "
                             "WHERE "
                             "artist.id = file_join.artist AND "
                             "track.id = file_join.track AND "
                             "file.id = file_join.file AND "
-                            "(%1 AND %2)" )
+                            "(%2 AND %3)" )
+         .arg( ResultHydrator::columns() )
          .arg( artsToken )
          .arg( trksToken );
 
     files_query.prepare( sql );
     files_query.exec();
 
+    ResultHydrator hydrator( lib );
     while ( files_query.next() )
     {
-        source_ptr s;
-        QString url = files_query.value( 0 ).toString();
-
-        if ( files_query.value( 13 ).toUInt() == 0 )
-        {
-            s = SourceList::instance()->getLocal();
-        }
-        else
-        {
-            s = SourceList::instance()->get( files_query.value( 13 ).toUInt() );
-            if( s.isNull() )
-            {
-                qDebug() << "Could not find source" << files_query.value( 13 ).toUInt();
-                continue;
-            }
+        Tomahawk::result_ptr result = hydrator.result( files_query );
+        if ( result.isNull() )
+            continue;
 
-            url = QString( "servent://%1\t%2" ).arg( s->userName() ).arg( url );
-        }
-
-        Tomahawk::result_ptr result = Tomahawk::Result::get( url );
-        Tomahawk::artist_ptr artist = Tomahawk::Artist::get( files_query.value( 15 ).toUInt(), files_query.value( 10 ).toString() );
-        Tomahawk::album_ptr album = Tomahawk::Album::get( files_query.value( 16 ).toUInt(), files_query.value( 11 ).toString(), artist );
-
-        result->setModificationTime( files_query.value( 1 ).toUInt() );
-        result->setSize( files_query.value( 2 ).toUInt() );
-        result->setMimetype( files_query.value( 4 ).toString() );
-        result->setDuration( files_query.value( 5 ).toUInt() );
-        result->setBitrate( files_query.value( 6 ).toUInt() );
-        result->setArtist( artist );
-        result->setAlbum( album );
-        result->setTrack( files_query.value( 12 ).toString() );
         result->setRID( uuid() );
-        result->setAlbumPos( files_query.value( 14 ).toUInt() );
-        result->setTrackId( files_query.value( 9 ).toUInt() );
-
-        TomahawkSqlQuery attrQuery = lib->newquery();
-        QVariantMap attr;
-
-        attrQuery.prepare( "SELECT k, v FROM track_attributes WHERE id = ?" );
-        attrQuery.bindValue( 0, result->trackId() );
-        attrQuery.exec();
-        while ( attrQuery.next() )
-        {
-            attr[ attrQuery.value( 0 ).toString() ] = attrQuery.value( 1 ).toString();
-        }
-
-        result->setAttributes( attr );
-        result->setCollection( s->collection() );
         res << result;
     }
 
+    hydrator.loadAttributes();
+
     emit results( m_query->id(), res );
 }
 
@@ -189,37 +162,53 @@ DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib )
     QList< QPair<int, float> > trackPairs = lib->searchTable( "track", m_query->fullTextQuery(), 20 );
     QList< QPair<int, float> > albumPairs = lib->searchTable( "album", m_query->fullTextQuery(), 20 );
 
-    foreach ( const scorepair_t& artistPair, artistPairs )
+    // look up the names of all candidates at once, in the order of their scores
+    if ( !artistPairs.isEmpty() )
     {
-        TomahawkSqlQuery query = lib->newquery();
+        QStringList ids;
+        foreach ( const scorepair_t& artistPair, artistPairs )
+            ids << QString::number( artistPair.first );
 
-        QString sql = QString( "SELECT name FROM artist WHERE id = %1" ).arg( artistPair.first );
-        query.prepare( sql );
+        TomahawkSqlQuery query = lib->newquery();
+        query.prepare( QString( "SELECT id, name FROM artist WHERE id IN (%1)" ).arg( ids.join( "," ) ) );
         query.exec();
 
-        QList<Tomahawk::artist_ptr> artistList;
+        QHash< int, Tomahawk::artist_ptr > found;
         while ( query.next() )
+            found.insert( query.value( 0 ).toInt(), Tomahawk::Artist::get( query.value( 0 ).toUInt(), query.value( 1 ).toString() ) );
+
+        QList<Tomahawk::artist_ptr> artistList;
+        foreach ( const scorepair_t& artistPair, artistPairs )
         {
-            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( artistPair.first, query.value( 0 ).toString() );
-            artistList << artist;
+            if ( found.contains( artistPair.first ) )
+                artistList << found.value( artistPair.first );
         }
 
         emit artists( m_query->id(), artistList );
     }
-    foreach ( const scorepair_t& albumPair, albumPairs )
+    if ( !albumPairs.isEmpty() )
     {
-        TomahawkSqlQuery query = lib->newquery();
+        QStringList ids;
+        foreach ( const scorepair_t& albumPair, albumPairs )
+            ids << QString::number( albumPair.first );
 
-        QString sql = QString( "SELECT album.name, artist.id, artist.name FROM album, artist WHERE artist.id = album.artist AND album.id = %1" ).arg( albumPair.first );
-        query.prepare( sql );
+        TomahawkSqlQuery query = lib->newquery();
+        query.prepare( QString( "SELECT album.id, album.name, artist.id, artist.name FROM album, artist "
+                                "WHERE artist.id = album.artist AND album.id IN (%1)" ).arg( ids.join( "," ) ) );
         query.exec();
 
-        QList<Tomahawk::album_ptr> albumList;
+        QHash< int, Tomahawk::album_ptr > found;
         while ( query.next() )
         {
-            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( query.value( 1 ).toUInt(), query.value( 2 ).toString() );
-            Tomahawk::album_ptr album = Tomahawk::Album::get( albumPair.first, query.value( 0 ).toString(), artist );
-            albumList << album;
+            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( query.value( 2 ).toUInt(), query.value( 3 ).toString() );
+            found.insert( query.value( 0 ).toInt(), Tomahawk::Album::get( query.value( 0 ).toUInt(), query.value( 1 ).toString(), artist ) );
+        }
+
+        QList<Tomahawk::album_ptr> albumList;
+        foreach ( const scorepair_t& albumPair, albumPairs )
+        {
+            if ( found.contains( albumPair.first ) )
+                albumList << found.value( albumPair.first );
         }
 
         emit albums( m_query->id(), albumList );
@@ -247,64 +236,28 @@ DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib )
     QString trksToken = QString( "file_join.track IN (%1)" ).arg( trksl.join( "," ) );
     QString albsToken = QString( "file_join.album IN (%1)" ).arg( albsl.join( "," ) );
 
-    QString sql = QString( "SELECT "
-                            "url, mtime, size, md5, mimetype, duration, bitrate, file_join.artist, file_join.album, file_join.track, "
-                            "artist.name as artname, "
-                            "album.name as albname, "
-                            "track.name as trkname, "
-                            "file.source, "
-                            "file_join.albumpos, "
-                            "artist.id as artid, "
-                            "album.id as albid "
+    QString sql = QString( "SELECT %1 "
                             "FROM file, file_join, artist, track "
                             "LEFT JOIN album ON album.id = file_join.album "
                             "WHERE "
                             "artist.id = file_join.artist AND "
                             "track.id = file_join.track AND "
                             "file.id = file_join.file AND "
-                            "%1" )
+                            "%2" )
+                        .arg( ResultHydrator::columns() )
                         .arg( trackPairs.length() > 0 ? trksToken : QString( "0" ) );
 
     files_query.prepare( sql );
     files_query.exec();
 
+    ResultHydrator hydrator( lib );
     while ( files_query.next() )
     {
-        source_ptr s;
-        QString url = files_query.value( 0 ).toString();
-
-        if ( files_query.value( 13 ).toUInt() == 0 )
-        {
-            s = SourceList::instance()->getLocal();
-        }
-        else
-        {
-            s = SourceList::instance()->get( files_query.value( 13 ).toUInt() );
-            if( s.isNull() )
-            {
-                qDebug() << "Could not find source" << files_query.value( 13 ).toUInt();
-                continue;
-            }
-
-            url = QString( "servent://%1\t%2" ).arg( s->userName() ).arg( url );
-        }
+        Tomahawk::result_ptr result = hydrator.result( files_query );
+        if ( result.isNull() )
+            continue;
 
-        Tomahawk::result_ptr result = Tomahawk::Result::get( url );
-        Tomahawk::artist_ptr artist = Tomahawk::Artist::get( files_query.value( 15 ).toUInt(), files_query.value( 10 ).toString() );
-        Tomahawk::album_ptr album = Tomahawk::Album::get( files_query.value( 16 ).toUInt(), files_query.value( 11 ).toString(), artist );
-
-        result->setModificationTime( files_query.value( 1 ).toUInt() );
-        result->setSize( files_query.value( 2 ).toUInt() );
-        result->setMimetype( files_query.value( 4 ).toString() );
-        result->setDuration( files_query.value( 5 ).toUInt() );
-        result->setBitrate( files_query.value( 6 ).toUInt() );
-        result->setArtist( artist );
-        result->setAlbum( album );
-        result->setTrack( files_query.value( 12 ).toString() );
         result->setRID( uuid() );
-        result->setAlbumPos( files_query.value( 14 ).toUInt() );
-        result->setTrackId( files_query.value( 9 ).toUInt() );
-        result->setYear( files_query.value( 17 ).toUInt() );
 
         for ( int k = 0; k < trackPairs.count(); k++ )
         {
@@ -315,22 +268,103 @@ DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib )
             }
         }
 
-        TomahawkSqlQuery attrQuery = lib->newquery();
-        QVariantMap attr;
+        res << result;
+    }
+
+    // the release year comes with the attributes
+    hydrator.loadAttributes();
+
+    emit results( m_query->id(), res );
+}
+
+
+void
+DatabaseCommand_Resolve::ftsResolve( DatabaseImpl* lib )
+{
+    QList<Tomahawk::result_ptr> res;
+
+    const QString match = DatabaseImpl::fullTextMatch( m_query->fullTextQuery() );
+    if ( match.isEmpty() )
+    {
+        emit results( m_query->id(), res );
+        return;
+    }
+    const QString sortname = DatabaseImpl::sortname( m_query->fullTextQuery() );
+
+    // every kind gets sent on as soon as we have it, so the search view fills up while we're still busy.
+    // a single ranked query each, the rows come with all the names we need
+    {
+        TomahawkSqlQuery query = lib->newquery();
+        query.prepare( "SELECT artist.id, artist.name FROM artist_fts, artist "
+                       "WHERE artist_fts MATCH ? AND artist.id = artist_fts.docid "
+                       "ORDER BY artist.sortname = ? DESC, length( artist.name ), artist.id "
+                       "LIMIT ?" );
+        query.addBindValue( match );
+        query.addBindValue( sortname );
+        query.addBindValue( FTS_MAX_MATCHES );
+        query.exec();
 
-        attrQuery.prepare( "SELECT k, v FROM track_attributes WHERE id = ?" );
-        attrQuery.bindValue( 0, result->trackId() );
-        attrQuery.exec();
-        while ( attrQuery.next() )
+        QList<Tomahawk::artist_ptr> artistList;
+        while ( query.next() )
+            artistList << Tomahawk::Artist::get( query.value( 0 ).toUInt(), query.value( 1 ).toString() );
+
+        if ( !artistList.isEmpty() )
+            emit artists( m_query->id(), artistList );
+    }
+    {
+        TomahawkSqlQuery query = lib->newquery();
+        query.prepare( "SELECT album.id, album.name, artist.id, artist.name FROM album_fts, album, artist "
+                       "WHERE album_fts MATCH ? AND album.id = album_fts.docid AND artist.id = album.artist "
+                       "ORDER BY album.sortname = ? DESC, length( album.name ), album.id "
+                       "LIMIT ?" );
+        query.addBindValue( match );
+        query.addBindValue( sortname );
+        query.addBindValue( FTS_MAX_MATCHES );
+        query.exec();
+
+        QList<Tomahawk::album_ptr> albumList;
+        while ( query.next() )
         {
-            attr[ attrQuery.value( 0 ).toString() ] = attrQuery.value( 1 ).toString();
+            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( query.value( 2 ).toUInt(), query.value( 3 ).toString() );
+            albumList << Tomahawk::Album::get( query.value( 0 ).toUInt(), query.value( 1 ).toString(), artist );
         }
 
-        result->setAttributes( attr );
+        if ( !albumList.isEmpty() )
+            emit albums( m_query->id(), albumList );
+    }
 
-        result->setCollection( s->collection() );
+    TomahawkSqlQuery files_query = lib->newquery();
+    files_query.prepare( QString( "SELECT %1 "
+                                  "FROM track_fts, file, file_join, artist, track "
+                                  "LEFT JOIN album ON album.id = file_join.album "
+                                  "WHERE "
+                                  "track_fts MATCH ? AND "
+                                  "track.id = track_fts.docid AND "
+                                  "file_join.track = track.id AND "
+                                  "artist.id = file_join.artist AND "
+                                  "file.id = file_join.file "
+                                  "ORDER BY track.sortname = ? DESC, length( track.name ), track.id "
+                                  "LIMIT ?" )
+                         .arg( ResultHydrator::columns() ) );
+    files_query.addBindValue( match );
+    files_query.addBindValue( sortname );
+    files_query.addBindValue( FTS_MAX_RESULTS );
+    files_query.exec();
+
+    ResultHydrator hydrator( lib );
+    while ( files_query.next() )
+    {
+        Tomahawk::result_ptr result = hydrator.result( files_query );
+        if ( result.isNull() )
+            continue;
+
+        result->setRID( uuid() );
+        result->setScore( ftsScore( sortname, result->track() ) );
         res << result;
     }
 
+    // the release year comes with the attributes
+    hydrator.loadAttributes();
+
     emit results( m_query->id(), res );
 }
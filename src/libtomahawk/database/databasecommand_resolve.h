@@ -50,6 +50,7 @@ private:
     DatabaseCommand_Resolve();
 
     void fullTextResolve( DatabaseImpl* lib );
+    void ftsResolve( DatabaseImpl* lib );
     void resolve( DatabaseImpl* lib );
 
     Tomahawk::query_ptr m_query;
@@ -0,0 +1,217 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "databasecommand_resolvebatch.h"
+#include "resulthydrator.h"
+
+#include <QSet>
+
+#include "artist.h"
+#include "album.h"
+#include "sourcelist.h"
+#include "utils/logger.h"
+
+// how many queries we look up with a single SQL statement
+#define QUERIES_PER_CHUNK 50
+
+using namespace Tomahawk;
+
+
+DatabaseCommand_ResolveBatch::DatabaseCommand_ResolveBatch( const QList< query_ptr >& queries )
+    : DatabaseCommand()
+    , m_queries( queries )
+{
+}
+
+
+DatabaseCommand_ResolveBatch::~DatabaseCommand_ResolveBatch()
+{
+}
+
+
+void
+DatabaseCommand_ResolveBatch::exec( DatabaseImpl* lib )
+{
+    // with a connection of our own, one read transaction gives the whole batch a consistent snapshot
+    const bool readTransaction = lib->hasThreadConnection() && lib->database().transaction();
+
+    QList< query_ptr > pending;
+
+    foreach ( const query_ptr& query, m_queries )
+    {
+        if ( query->isFullTextQuery() )
+        {
+            // full-text queries are resolved by DatabaseCommand_Resolve
+            Q_ASSERT( false );
+            emit results( query->id(), QList<Tomahawk::result_ptr>() );
+            continue;
+        }
+
+        if ( !query->resultHint().isEmpty() )
+        {
+            Tomahawk::result_ptr result = lib->resultFromHint( query );
+            if ( !result.isNull() && !result->collection().isNull() && result->collection()->source()->isOnline() )
+            {
+                QList<Tomahawk::result_ptr> res;
+                res << result;
+                emit results( query->id(), res );
+                continue;
+            }
+        }
+
+        pending << query;
+        if ( pending.count() == QUERIES_PER_CHUNK )
+        {
+            resolveChunk( lib, pending );
+            pending.clear();
+        }
+    }
+
+    if ( !pending.isEmpty() )
+        resolveChunk( lib, pending );
+
+    if ( readTransaction )
+        lib->database().commit();
+
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Resolved" << m_queries.count() << "queries with" << m_candidateCache.count() << "fuzzy lookups";
+}
+
+
+QList< QPair<int, float> >
+DatabaseCommand_ResolveBatch::candidates( DatabaseImpl* lib, const QString& table, const QString& name )
+{
+    const QString key = table + '\t' + DatabaseImpl::sortname( name );
+    if ( m_candidateCache.contains( key ) )
+        return m_candidateCache.value( key );
+
+    QList< QPair<int, float> > c = lib->searchTable( table, name );
+    m_candidateCache.insert( key, c );
+    return c;
+}
+
+
+void
+DatabaseCommand_ResolveBatch::resolveChunk( DatabaseImpl* lib, const QList< query_ptr >& queries )
+{
+    // STEP 1
+    // for every query, the set of artist ids it accepts and a reverse index from track id to queries
+    QList< QSet<int> > artistSets;
+    QHash< int, QList<int> > queriesForTrack;
+    QSet<int> allArtists, allTracks;
+
+    for ( int i = 0; i < queries.count(); i++ )
+    {
+        const query_ptr& query = queries.at( i );
+        QSet<int> arts;
+
+        QList< QPair<int, float> > artists = candidates( lib, "artist", query->artist() );
+        QList< QPair<int, float> > tracks = candidates( lib, "track", query->track() );
+
+        if ( artists.length() && tracks.length() )
+        {
+            for ( int k = 0; k < artists.count(); k++ )
+            {
+                arts << artists.at( k ).first;
+                allArtists << artists.at( k ).first;
+            }
+            for ( int k = 0; k < tracks.count(); k++ )
+            {
+                queriesForTrack[ tracks.at( k ).first ] << i;
+                allTracks << tracks.at( k ).first;
+            }
+        }
+
+        artistSets << arts;
+    }
+
+    QList< QList<Tomahawk::result_ptr> > res;
+    for ( int i = 0; i < queries.count(); i++ )
+        res << QList<Tomahawk::result_ptr>();
+
+    if ( allArtists.isEmpty() || allTracks.isEmpty() )
+    {
+        qDebug() << "No candidates found in first pass for any query in this chunk";
+        for ( int i = 0; i < queries.count(); i++ )
+            emit results( queries.at( i )->id(), res.at( i ) );
+
+        return;
+    }
+
+    // STEP 2
+    QStringList artsl, trksl;
+    foreach ( int id, allArtists )
+        artsl.append( QString::number( id ) );
+    foreach ( int id, allTracks )
+        trksl.append( QString::number( id ) );
+
+    QString artsToken = QString( "file_join.artist IN (%1)" ).arg( artsl.join( "," ) );
+    QString trksToken = QString( "file_join.track IN (%1)" ).arg( trksl.join( "," ) );
+
+    QString sql = QString( "SELECT %1 "
+                            "FROM file, file_join, artist, track "
+                            "LEFT JOIN album ON album.id = file_join.album "
+                            "WHERE "
+                            "artist.id = file_join.artist AND "
+                            "track.id = file_join.track AND "
+                            "file.id = file_join.file AND "
+                            "(%2 AND %3)" )
+         .arg( ResultHydrator::columns() )
+         .arg( artsToken )
+         .arg( trksToken );
+
+    TomahawkSqlQuery files_query = lib->newquery();
+    files_query.prepare( sql );
+    files_query.exec();
+
+    ResultHydrator hydrator( lib );
+    QList< QPair< Tomahawk::result_ptr, int > > matches;
+
+    while ( files_query.next() )
+    {
+        const int artistId = files_query.value( 7 ).toInt();
+        const int trackId = files_query.value( 9 ).toInt();
+
+        // the IN clauses span all queries of this chunk, so only keep rows a query actually asked for
+        QList<int> owners;
+        foreach ( int i, queriesForTrack.value( trackId ) )
+        {
+            if ( artistSets.at( i ).contains( artistId ) )
+                owners << i;
+        }
+        if ( owners.isEmpty() )
+            continue;
+
+        Tomahawk::result_ptr result = hydrator.result( files_query );
+        if ( result.isNull() )
+            continue;
+
+        result->setRID( uuid() );
+
+        foreach ( int i, owners )
+            matches << QPair< Tomahawk::result_ptr, int >( result, i );
+    }
+
+    // fetch the attributes of all matched tracks at once
+    hydrator.loadAttributes();
+
+    for ( int k = 0; k < matches.count(); k++ )
+        res[ matches.at( k ).second ] << matches.at( k ).first;
+
+    for ( int i = 0; i < queries.count(); i++ )
+        emit results( queries.at( i )->id(), res.at( i ) );
+}
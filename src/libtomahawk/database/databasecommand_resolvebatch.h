@@ -0,0 +1,66 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATABASECOMMAND_RESOLVEBATCH_H
+#define DATABASECOMMAND_RESOLVEBATCH_H
+
+#include "databasecommand.h"
+#include "databaseimpl.h"
+#include "result.h"
+#include "artist.h"
+#include "album.h"
+
+#include <QVariant>
+
+#include "dllmacro.h"
+
+/*
+    Resolves a whole list of (non full-text) queries in one go. Fuzzy index
+    lookups are shared between queries with the same artist / track name and
+    the file lookups are done with one SQL query per chunk of queries instead
+    of one per query. Results are still reported per QID, exactly like
+    DatabaseCommand_Resolve does.
+*/
+class DLLEXPORT DatabaseCommand_ResolveBatch : public DatabaseCommand
+{
+Q_OBJECT
+public:
+    explicit DatabaseCommand_ResolveBatch( const QList< Tomahawk::query_ptr >& queries );
+    virtual ~DatabaseCommand_ResolveBatch();
+
+    virtual QString commandname() const { return "dbresolvebatch"; }
+    virtual bool doesMutates() const { return false; }
+
+    virtual void exec( DatabaseImpl *lib );
+
+signals:
+    void results( Tomahawk::QID qid, QList<Tomahawk::result_ptr> results );
+
+private:
+    DatabaseCommand_ResolveBatch();
+
+    void resolveChunk( DatabaseImpl* lib, const QList< Tomahawk::query_ptr >& queries );
+    QList< QPair<int, float> > candidates( DatabaseImpl* lib, const QString& table, const QString& name );
+
+    QList< Tomahawk::query_ptr > m_queries;
+
+    // fuzzy index lookups already done during this batch, keyed by table and sortname
+    QHash< QString, QList< QPair<int, float> > > m_candidateCache;
+};
+
+#endif // DATABASECOMMAND_RESOLVEBATCH_H
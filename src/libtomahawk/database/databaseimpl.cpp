@@ -19,6 +19,7 @@
 
 #include "databaseimpl.h"
 
+#include <QAtomicInt>
 #include <QCoreApplication>
 #include <QRegExp>
 #include <QStringList>
@@ -27,10 +28,12 @@
 
 #include "database/database.h"
 #include "databasecommand_updatesearchindex.h"
+#include "resulthydrator.h"
 #include "sourcelist.h"
 #include "result.h"
 #include "artist.h"
 #include "album.h"
+#include "tomahawksettings.h"
 #include "utils/tomahawkutils.h"
 #include "utils/logger.h"
 
@@ -40,14 +43,13 @@
 */
 #include "schema.sql.h"
 
-#define CURRENT_SCHEMA_VERSION 27
+#define CURRENT_SCHEMA_VERSION 28
 
 
 DatabaseImpl::DatabaseImpl( const QString& dbname, Database* parent )
     : QObject( (QObject*) parent )
-    , m_lastartid( 0 )
-    , m_lastalbid( 0 )
-    , m_lasttrkid( 0 )
+    , m_dbname( dbname )
+    , m_fullTextIndex( false )
 {
     QTime t;
     t.start();
@@ -69,6 +71,8 @@ DatabaseImpl::DatabaseImpl( const QString& dbname, Database* parent )
     tLog() << "Database ID:" << m_dbid;
 
      // make sqlite behave how we want:
+    // WAL lets the read-only workers' connections read while the rw worker writes
+    query.exec( "PRAGMA journal_mode = WAL" );
     query.exec( "PRAGMA auto_vacuum = FULL" );
     query.exec( "PRAGMA synchronous  = ON" );
     query.exec( "PRAGMA foreign_keys = ON" );
@@ -80,15 +84,41 @@ DatabaseImpl::DatabaseImpl( const QString& dbname, Database* parent )
 
     m_fuzzyIndex = new FuzzyIndex( *this, schemaUpdated );
     tDebug( LOGVERBOSE ) << "Loaded index:" << t.elapsed();
+
+    m_fullTextIndex = setupFullTextIndex( TomahawkSettings::instance()->fullTextSearchIndex() );
+    tDebug( LOGVERBOSE ) << "Set up full-text index:" << t.elapsed();
 }
 
 
 DatabaseImpl::~DatabaseImpl()
 {
+    tDebug() << "Statement cache hit rate:" << TomahawkSqlQueryCache::hitRate()
+             << "(" << TomahawkSqlQueryCache::hits() << "hits," << TomahawkSqlQueryCache::misses() << "misses )";
+
+    clearStatementCache();
     delete m_fuzzyIndex;
 }
 
 
+TomahawkSqlQuery
+DatabaseImpl::cachedQuery( const QString& sql )
+{
+    // every thread only ever uses one connection, so a cache per thread is a cache per connection
+    if ( !m_statementCache.hasLocalData() )
+        m_statementCache.setLocalData( new TomahawkSqlQueryCache( database() ) );
+
+    return m_statementCache.localData()->query( sql );
+}
+
+
+void
+DatabaseImpl::clearStatementCache()
+{
+    if ( m_statementCache.hasLocalData() )
+        m_statementCache.setLocalData( 0 );
+}
+
+
 void
 DatabaseImpl::loadIndex()
 {
@@ -172,16 +202,16 @@ Tomahawk::result_ptr
 DatabaseImpl::file( int fid )
 {
     Tomahawk::result_ptr r;
-    TomahawkSqlQuery query = newquery();
-    query.exec( QString( "SELECT url, mtime, size, md5, mimetype, duration, bitrate, "
-                         "file_join.artist, file_join.album, file_join.track, "
-                         "(select name from artist where id = file_join.artist) as artname, "
-                         "(select name from album  where id = file_join.album)  as albname, "
-                         "(select name from track  where id = file_join.track)  as trkname, "
-                         "source "
-                         "FROM file, file_join "
-                         "WHERE file.id = file_join.file AND file.id = %1" )
-                .arg( fid ) );
+    TomahawkSqlQuery query = cachedQuery( "SELECT url, mtime, size, md5, mimetype, duration, bitrate, "
+                                          "file_join.artist, file_join.album, file_join.track, "
+                                          "(select name from artist where id = file_join.artist) as artname, "
+                                          "(select name from album  where id = file_join.album)  as albname, "
+                                          "(select name from track  where id = file_join.track)  as trkname, "
+                                          "source "
+                                          "FROM file, file_join "
+                                          "WHERE file.id = file_join.file AND file.id = ?" );
+    query.bindValue( 0, fid );
+    query.exec();
 
     if ( query.next() )
     {
@@ -197,6 +227,8 @@ DatabaseImpl::file( int fid )
             s = SourceList::instance()->get( query.value( 13 ).toUInt() );
             if ( s.isNull() )
             {
+                // a cached statement left on a row keeps the connection's read snapshot alive
+                query.finish();
                 return r;
             }
 
@@ -220,6 +252,7 @@ DatabaseImpl::file( int fid )
         r->setScore( 1.0 );
         r->setFileId( fid );
     }
+    query.finish();
 
     return r;
 }
@@ -228,33 +261,34 @@ DatabaseImpl::file( int fid )
 int
 DatabaseImpl::artistId( const QString& name_orig, bool autoCreate )
 {
-    if ( m_lastart == name_orig )
-        return m_lastartid;
-
     int id = 0;
     QString sortname = DatabaseImpl::sortname( name_orig );
+    const QString key = IdCache::key( IdCache::Artist, 0, sortname );
+    const bool mainConnection = !hasThreadConnection();
 
-    TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM artist WHERE sortname = ?" );
-    query.addBindValue( sortname );
+    if ( ( id = m_idCache.find( IdCache::Artist, key, mainConnection ) ) )
+        return id;
+
+    TomahawkSqlQuery query = cachedQuery( "SELECT id FROM artist WHERE sortname = ?" );
+    query.bindValue( 0, sortname );
     query.exec();
     if ( query.next() )
     {
         id = query.value( 0 ).toInt();
     }
+    query.finish();
     if ( id )
     {
-        m_lastart = name_orig;
-        m_lastartid = id;
+        m_idCache.insert( IdCache::Artist, key, id, mainConnection );
         return id;
     }
 
     if ( autoCreate )
     {
         // not found, insert it.
-        query.prepare( "INSERT INTO artist(id,name,sortname) VALUES(NULL,?,?)" );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
+        query = cachedQuery( "INSERT INTO artist(id,name,sortname) VALUES(NULL,?,?)" );
+        query.bindValue( 0, name_orig );
+        query.bindValue( 1, sortname );
         if ( !query.exec() )
         {
             tDebug() << "Failed to insert artist:" << name_orig;
@@ -262,8 +296,7 @@ DatabaseImpl::artistId( const QString& name_orig, bool autoCreate )
         }
 
         id = query.lastInsertId().toInt();
-        m_lastart = name_orig;
-        m_lastartid = id;
+        m_idCache.insert( IdCache::Artist, key, id, mainConnection );
     }
 
     return id;
@@ -275,31 +308,35 @@ DatabaseImpl::trackId( int artistid, const QString& name_orig, bool autoCreate )
 {
     int id = 0;
     QString sortname = DatabaseImpl::sortname( name_orig );
-    //if( ( id = m_artistcache[sortname] ) ) return id;
+    const QString key = IdCache::key( IdCache::Track, artistid, sortname );
+    const bool mainConnection = !hasThreadConnection();
 
-    TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM track WHERE artist = ? AND sortname = ?" );
-    query.addBindValue( artistid );
-    query.addBindValue( sortname );
+    if ( ( id = m_idCache.find( IdCache::Track, key, mainConnection ) ) )
+        return id;
+
+    TomahawkSqlQuery query = cachedQuery( "SELECT id FROM track WHERE artist = ? AND sortname = ?" );
+    query.bindValue( 0, artistid );
+    query.bindValue( 1, sortname );
     query.exec();
 
     if ( query.next() )
     {
         id = query.value( 0 ).toInt();
     }
+    query.finish();
     if ( id )
     {
-        //m_trackcache[sortname]=id;
+        m_idCache.insert( IdCache::Track, key, id, mainConnection );
         return id;
     }
 
     if ( autoCreate )
     {
         // not found, insert it.
-        query.prepare( "INSERT INTO track(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
-        query.addBindValue( artistid );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
+        query = cachedQuery( "INSERT INTO track(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
+        query.bindValue( 0, artistid );
+        query.bindValue( 1, name_orig );
+        query.bindValue( 2, sortname );
         if ( !query.exec() )
         {
             tDebug() << "Failed to insert track:" << name_orig;
@@ -307,6 +344,7 @@ DatabaseImpl::trackId( int artistid, const QString& name_orig, bool autoCreate )
         }
 
         id = query.lastInsertId().toInt();
+        m_idCache.insert( IdCache::Track, key, id, mainConnection );
     }
 
     return id;
@@ -322,36 +360,36 @@ DatabaseImpl::albumId( int artistid, const QString& name_orig, bool autoCreate )
         return 0;
     }
 
-    if ( m_lastartid == artistid && m_lastalb == name_orig )
-        return m_lastalbid;
-
     int id = 0;
     QString sortname = DatabaseImpl::sortname( name_orig );
-    //if( ( id = m_albumcache[sortname] ) ) return id;
+    const QString key = IdCache::key( IdCache::Album, artistid, sortname );
+    const bool mainConnection = !hasThreadConnection();
 
-    TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM album WHERE artist = ? AND sortname = ?" );
-    query.addBindValue( artistid );
-    query.addBindValue( sortname );
+    if ( ( id = m_idCache.find( IdCache::Album, key, mainConnection ) ) )
+        return id;
+
+    TomahawkSqlQuery query = cachedQuery( "SELECT id FROM album WHERE artist = ? AND sortname = ?" );
+    query.bindValue( 0, artistid );
+    query.bindValue( 1, sortname );
     query.exec();
     if ( query.next() )
     {
         id = query.value( 0 ).toInt();
     }
+    query.finish();
     if ( id )
     {
-        m_lastalb = name_orig;
-        m_lastalbid = id;
+        m_idCache.insert( IdCache::Album, key, id, mainConnection );
         return id;
     }
 
     if ( autoCreate )
     {
         // not found, insert it.
-        query.prepare( "INSERT INTO album(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
-        query.addBindValue( artistid );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
+        query = cachedQuery( "INSERT INTO album(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
+        query.bindValue( 0, artistid );
+        query.bindValue( 1, name_orig );
+        query.bindValue( 2, sortname );
         if( !query.exec() )
         {
             tDebug() << "Failed to insert album:" << name_orig;
@@ -359,8 +397,7 @@ DatabaseImpl::albumId( int artistid, const QString& name_orig, bool autoCreate )
         }
 
         id = query.lastInsertId().toInt();
-        m_lastalb = name_orig;
-        m_lastalbid = id;
+        m_idCache.insert( IdCache::Album, key, id, mainConnection );
     }
 
     return id;
@@ -394,15 +431,81 @@ DatabaseImpl::searchTable( const QString& table, const QString& name, uint limit
 }
 
 
+bool
+DatabaseImpl::setupFullTextIndex( bool enable )
+{
+    const QStringList tables = QStringList() << "artist" << "album" << "track";
+    TomahawkSqlQuery query = newquery();
+
+    if ( !enable )
+    {
+        // don't keep paying for the triggers once it got disabled again. The tables go as well:
+        // without the triggers they'd go stale, and re-enabling only fills in missing tables
+        foreach ( const QString& table, tables )
+        {
+            query.exec( QString( "DROP TRIGGER IF EXISTS %1_fts_insert" ).arg( table ) );
+            query.exec( QString( "DROP TRIGGER IF EXISTS %1_fts_delete" ).arg( table ) );
+            query.exec( QString( "DROP TABLE IF EXISTS %1_fts" ).arg( table ) );
+        }
+
+        return false;
+    }
+
+    m_db.transaction();
+    foreach ( const QString& table, tables )
+    {
+        query.exec( QString( "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = '%1_fts'" ).arg( table ) );
+        if ( !query.next() )
+        {
+            // not every sqlite build comes with FTS3, so don't go through TomahawkSqlQuery's error handling
+            QSqlQuery probe( m_db );
+            if ( !probe.exec( QString( "CREATE VIRTUAL TABLE %1_fts USING fts3( name )" ).arg( table ) ) )
+            {
+                tLog() << "Could not create full-text index, falling back to the fuzzy index:" << probe.lastError().text();
+                m_db.rollback();
+                return false;
+            }
+
+            // only done when the table is new, the triggers keep it in sync from here on
+            query.exec( QString( "INSERT INTO %1_fts( docid, name ) SELECT id, name FROM %1" ).arg( table ) );
+        }
+
+        query.exec( QString( "CREATE TRIGGER IF NOT EXISTS %1_fts_insert AFTER INSERT ON %1 "
+                             "BEGIN INSERT INTO %1_fts( docid, name ) VALUES( new.id, new.name ); END" ).arg( table ) );
+        query.exec( QString( "CREATE TRIGGER IF NOT EXISTS %1_fts_delete AFTER DELETE ON %1 "
+                             "BEGIN DELETE FROM %1_fts WHERE docid = old.id; END" ).arg( table ) );
+    }
+    m_db.commit();
+
+    tLog() << "Using the SQLite full-text index for searches";
+    return true;
+}
+
+
+QString
+DatabaseImpl::fullTextMatch( const QString& text )
+{
+    // FTS query syntax would otherwise leak through, so only keep plain words
+    QStringList terms = text.toLower().split( QRegExp( "[^\\w]+" ), QString::SkipEmptyParts );
+
+    if ( terms.isEmpty() )
+        return QString();
+
+    // the last word may still be incomplete
+    terms.last() += '*';
+    return terms.join( " " );
+}
+
+
 QList< int >
 DatabaseImpl::getTrackFids( int tid )
 {
     QList< int > ret;
 
-    TomahawkSqlQuery query = newquery();
-    query.exec( QString( "SELECT file.id FROM file, file_join "
-                         "WHERE file_join.file=file.id "
-                         "AND file_join.track = %1 ").arg( tid ) );
+    TomahawkSqlQuery query = cachedQuery( "SELECT file.id FROM file, file_join "
+                                          "WHERE file_join.file=file.id "
+                                          "AND file_join.track = ?" );
+    query.bindValue( 0, tid );
     query.exec();
 
     while( query.next() )
@@ -412,8 +515,10 @@ DatabaseImpl::getTrackFids( int tid )
 }
 
 
-QString
-DatabaseImpl::sortname( const QString& str, bool replaceArticle )
+#ifndef QT_NO_DEBUG
+// what sortname() used to be, it has to keep returning the exact same strings or stored sortnames stop matching
+static QString
+referenceSortname( const QString& str, bool replaceArticle )
 {
     QString s = str.toLower().trimmed().replace( QRegExp( "[\\s]{2,}" ), " " );
 
@@ -424,13 +529,91 @@ DatabaseImpl::sortname( const QString& str, bool replaceArticle )
 
     return s;
 }
+#endif
+
+
+QString
+DatabaseImpl::sortname( const QString& str, bool replaceArticle )
+{
+    /*
+        Single pass equivalent of
+            str.toLower().trimmed().replace( QRegExp( "[\\s]{2,}" ), " " )
+        followed by stripping a leading "the ". Only runs of two or more
+        whitespace characters collapse into a space, a single tab stays a tab.
+
+        Lowercasing is only done inline for plain ASCII. Anything else goes
+        through QString::toLower() first, which knows about the characters
+        lowercasing to more than one (U+0130 becomes "i\u0307").
+    */
+    bool ascii = true;
+    for ( int i = 0; i < str.length(); i++ )
+    {
+        if ( str.at( i ).unicode() >= 0x80 )
+        {
+            ascii = false;
+            break;
+        }
+    }
+
+    const QString lowered = ascii ? str : str.toLower();
+    const QChar* src = lowered.constData();
+    int begin = 0;
+    int end = lowered.length();
+    while ( begin < end && src[begin].isSpace() )
+        begin++;
+    while ( end > begin && src[end - 1].isSpace() )
+        end--;
+
+    QString s( end - begin, Qt::Uninitialized );
+    QChar* dst = s.data();
+    int len = 0;
+
+    for ( int i = begin; i < end; i++ )
+    {
+        const QChar c = src[i];
+        if ( c.isSpace() )
+        {
+            int run = i + 1;
+            while ( run < end && src[run].isSpace() )
+                run++;
+
+            if ( run - i > 1 )
+            {
+                dst[len++] = QLatin1Char( ' ' );
+                i = run - 1;
+            }
+            else
+                dst[len++] = c;
+        }
+        else if ( ascii && c.unicode() >= 'A' && c.unicode() <= 'Z' )
+            dst[len++] = QChar( c.unicode() + ( 'a' - 'A' ) );
+        else
+            dst[len++] = c;
+    }
+
+    int skip = 0;
+    if ( replaceArticle && len >= 4 && dst[0] == QLatin1Char( 't' ) && dst[1] == QLatin1Char( 'h' ) &&
+         dst[2] == QLatin1Char( 'e' ) && dst[3] == QLatin1Char( ' ' ) )
+    {
+        skip = 4;
+    }
+
+    // both only move data around within the buffer we already have
+    s.resize( len );
+    if ( skip )
+        s.remove( 0, skip );
+
+    Q_ASSERT( s == referenceSortname( str, replaceArticle ) );
+    return s;
+}
 
 
 QVariantMap
 DatabaseImpl::artist( int id )
 {
-    TomahawkSqlQuery query = newquery();
-    query.exec( QString( "SELECT id, name, sortname FROM artist WHERE id = %1" ).arg( id ) );
+    TomahawkSqlQuery query = cachedQuery( "SELECT id, name, sortname FROM artist WHERE id = ?" );
+    query.bindValue( 0, id );
+    query.exec();
 
     QVariantMap m;
     if( !query.next() )
@@ -439,6 +622,7 @@ DatabaseImpl::artist( int id )
     m["id"] = query.value( 0 );
     m["name"] = query.value( 1 );
     m["sortname"] = query.value( 2 );
+    query.finish();
     return m;
 }
 
@@ -446,8 +630,9 @@ DatabaseImpl::artist( int id )
 QVariantMap
 DatabaseImpl::track( int id )
 {
-    TomahawkSqlQuery query = newquery();
-    query.exec( QString( "SELECT id, artist, name, sortname FROM track WHERE id = %1" ).arg( id ) );
+    TomahawkSqlQuery query = cachedQuery( "SELECT id, artist, name, sortname FROM track WHERE id = ?" );
+    query.bindValue( 0, id );
+    query.exec();
 
     QVariantMap m;
     if( !query.next() )
@@ -457,6 +642,7 @@ DatabaseImpl::track( int id )
     m["artist"] = query.value( 1 );
     m["name"] = query.value( 2 );
     m["sortname"] = query.value( 3 );
+    query.finish();
     return m;
 }
 
@@ -464,8 +650,9 @@ DatabaseImpl::track( int id )
 QVariantMap
 DatabaseImpl::album( int id )
 {
-    TomahawkSqlQuery query = newquery();
-    query.exec( QString( "SELECT id, artist, name, sortname FROM album WHERE id = %1" ).arg( id ) );
+    TomahawkSqlQuery query = cachedQuery( "SELECT id, artist, name, sortname FROM album WHERE id = ?" );
+    query.bindValue( 0, id );
+    query.exec();
 
     QVariantMap m;
     if( !query.next() )
@@ -475,6 +662,7 @@ DatabaseImpl::album( int id )
     m["artist"] = query.value( 1 );
     m["name"] = query.value( 2 );
     m["sortname"] = query.value( 3 );
+    query.finish();
     return m;
 }
 
@@ -522,72 +710,85 @@ DatabaseImpl::resultFromHint( const Tomahawk::query_ptr& origquery )
 
     bool searchlocal = s->isLocal();
 
-    QString sql = QString( "SELECT "
-                            "url, mtime, size, md5, mimetype, duration, bitrate, file_join.artist, file_join.album, file_join.track, "
-                            "artist.name as artname, "
-                            "album.name as albname, "
-                            "track.name as trkname, "
-                            "file.source, "
-                            "file_join.albumpos, "
-                            "artist.id as artid, "
-                            "album.id as albid, "
-                            "track_attributes.v as year "
-                            "FROM file, file_join, artist, track, track_attributes "
+    QString sql = QString( "SELECT %1 "
+                            "FROM file, file_join, artist, track "
                             "LEFT JOIN album ON album.id = file_join.album "
                             "WHERE "
                             "artist.id = file_join.artist AND "
                             "track.id = file_join.track AND "
-                            "file.source %1 AND "
+                            "file.source %2 AND "
                             "file_join.file = file.id AND "
-                            "file.id = track_attributes.id AND "
                             "file.url = ?"
-        ).arg( searchlocal ? "IS NULL" : QString( "= %1" ).arg( s->id() ) );
+        ).arg( ResultHydrator::columns() )
+         .arg( searchlocal ? "IS NULL" : QString( "= %1" ).arg( s->id() ) );
 
     query.prepare( sql );
     query.bindValue( 0, fileUrl );
     query.exec();
 
-    if( query.next() )
+    if ( query.next() )
     {
-        Tomahawk::source_ptr s;
-        QString url = query.value( 0 ).toString();
+        // the release year comes with the attributes
+        ResultHydrator hydrator( this );
+        res = hydrator.result( query );
+        hydrator.loadAttributes();
 
-        if ( query.value( 13 ).toUInt() == 0 )
+        if ( !res.isNull() )
         {
-            s = SourceList::instance()->getLocal();
+            res->setScore( 1.0 );
+            res->setRID( uuid() );
         }
-        else
-        {
-            s = SourceList::instance()->get( query.value( 13 ).toUInt() );
-            if ( s.isNull() )
-            {
-                return res;
-            }
+    }
 
-            url = QString( "servent://%1\t%2" ).arg( s->userName() ).arg( url );
-        }
+    return res;
+}
 
-        res = Tomahawk::Result::get( url );
-        Tomahawk::artist_ptr artist = Tomahawk::Artist::get( query.value( 15 ).toUInt(), query.value( 10 ).toString() );
-        Tomahawk::album_ptr album = Tomahawk::Album::get( query.value( 16 ).toUInt(), query.value( 11 ).toString(), artist );
-
-        res->setModificationTime( query.value( 1 ).toUInt() );
-        res->setSize( query.value( 2 ).toUInt() );
-        res->setMimetype( query.value( 4 ).toString() );
-        res->setDuration( query.value( 5 ).toInt() );
-        res->setBitrate( query.value( 6 ).toInt() );
-        res->setArtist( artist );
-        res->setAlbum( album );
-        res->setScore( 1.0 );
-        res->setTrack( query.value( 12 ).toString() );
-        res->setAlbumPos( query.value( 14 ).toUInt() );
-        res->setRID( uuid() );
-        res->setTrackId( query.value( 9 ).toUInt() );
-        res->setCollection( s->collection() );
-        res->setYear( query.value( 17 ).toUInt() );
+
+bool
+DatabaseImpl::openThreadConnection()
+{
+    if ( m_threadDb.hasLocalData() )
+        return true;
+
+    static QAtomicInt s_connectionCount;
+    const QString name = QString( "tomahawk_ro_%1" ).arg( s_connectionCount.fetchAndAddRelaxed( 1 ) );
+
+    QSqlDatabase* db = new QSqlDatabase( QSqlDatabase::addDatabase( "QSQLITE", name ) );
+    db->setDatabaseName( m_dbname );
+    db->setConnectOptions( "QSQLITE_BUSY_TIMEOUT=5000" );
+    if ( !db->open() )
+    {
+        tLog() << "Failed to open thread connection to database" << m_dbname << "- sharing the main connection";
+        delete db;
+        QSqlDatabase::removeDatabase( name );
+        return false;
     }
 
-    return res;
+    QSqlQuery query( *db );
+    query.exec( "PRAGMA foreign_keys = ON" );
+
+    tDebug( LOGVERBOSE ) << "Opened database connection" << name << "for thread" << QThread::currentThread();
+    m_threadDb.setLocalData( db );
+    return true;
+}
+
+
+void
+DatabaseImpl::closeThreadConnection()
+{
+    if ( !m_threadDb.hasLocalData() )
+        return;
+
+    // cached statements must be gone before the connection is closed
+    clearStatementCache();
+
+    QSqlDatabase* db = m_threadDb.localData();
+    const QString name = db->connectionName();
+    db->close();
+
+    // deletes db, which must be gone before we can remove the connection
+    m_threadDb.setLocalData( 0 );
+    QSqlDatabase::removeDatabase( name );
 }
 
 
@@ -29,9 +29,11 @@
 #include <QSqlQuery>
 #include <QHash>
 #include <QThread>
+#include <QThreadStorage>
 
 #include "tomahawksqlquery.h"
 #include "fuzzyindex.h"
+#include "idcache.h"
 #include "typedefs.h"
 
 class Database;
@@ -42,6 +44,8 @@ Q_OBJECT
 
 friend class FuzzyIndex;
 friend class DatabaseCommand_UpdateSearchIndex;
+friend class DatabaseCommand_AddFiles;
+friend class DatabaseCommand_DeleteFiles;
 
 public:
     DatabaseImpl( const QString& dbname, Database* parent = 0 );
@@ -49,16 +53,30 @@ public:
 
     bool openDatabase( const QString& dbname );
 
-    TomahawkSqlQuery newquery() { return TomahawkSqlQuery( m_db ); }
-    QSqlDatabase& database() { return m_db; }
+    TomahawkSqlQuery newquery() { return TomahawkSqlQuery( database() ); }
+    QSqlDatabase& database() { return m_threadDb.hasLocalData() ? *m_threadDb.localData() : m_db; }
+
+    // gives the calling thread a sqlite connection of its own, used by the read-only db workers
+    bool openThreadConnection();
+    void closeThreadConnection();
+    bool hasThreadConnection() const { return m_threadDb.hasLocalData(); }
+
+    // prepared statements are cached per connection, see TomahawkSqlQueryCache
+    TomahawkSqlQuery cachedQuery( const QString& sql );
+    void clearStatementCache();
 
     int artistId( const QString& name_orig, bool autoCreate );
     int trackId( int artistid, const QString& name_orig, bool autoCreate );
     int albumId( int artistid, const QString& name_orig, bool autoCreate );
+    IdCache& idCache() { return m_idCache; }
 
     QList< QPair<int, float> > searchTable( const QString& table, const QString& name, uint limit = 0 );
     QList< int > getTrackFids( int tid );
 
+    // SQLite FTS tables mirroring the artist, album and track names, see setupFullTextIndex()
+    bool hasFullTextIndex() const { return m_fullTextIndex; }
+    static QString fullTextMatch( const QString& text );
+
     static QString sortname( const QString& str, bool replaceArticle = false );
 
     QVariantMap artist( int id );
@@ -84,15 +102,20 @@ public slots:
 private:
     QString cleanSql( const QString& sql );
     bool updateSchema( int oldVersion );
+    bool setupFullTextIndex( bool enable );
 
     bool m_ready;
     QSqlDatabase m_db;
+    QString m_dbname;
+
+    QThreadStorage< QSqlDatabase* > m_threadDb;
+    QThreadStorage< TomahawkSqlQueryCache* > m_statementCache;
 
-    QString m_lastart, m_lastalb, m_lasttrk;
-    int m_lastartid, m_lastalbid, m_lasttrkid;
+    IdCache m_idCache;
 
     QString m_dbid;
     FuzzyIndex* m_fuzzyIndex;
+    bool m_fullTextIndex;
 };
 
 #endif // DATABASEIMPL_H
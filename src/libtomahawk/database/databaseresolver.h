@@ -24,6 +24,8 @@
 #include "artist.h"
 #include "album.h"
 
+#include <QTimer>
+
 #include "dllmacro.h"
 
 class DLLEXPORT DatabaseResolver : public Tomahawk::Resolver
@@ -42,12 +44,18 @@ public slots:
     virtual void resolve( const Tomahawk::query_ptr& query );
 
 private slots:
+    void resolvePending();
+
     void gotResults( const Tomahawk::QID qid, QList< Tomahawk::result_ptr> results );
     void gotAlbums( const Tomahawk::QID qid, QList< Tomahawk::album_ptr> albums );
     void gotArtists( const Tomahawk::QID qid, QList< Tomahawk::artist_ptr> artists );
 
 private:
     int m_weight;
+
+    // queries dispatched to us within the same event loop iteration get resolved in one batch
+    QList< Tomahawk::query_ptr > m_pendingQueries;
+    QTimer m_batchTimer;
 };
 
 #endif // DATABASERESOLVER_H
@@ -26,20 +26,37 @@
 #include "database.h"
 #include "databaseimpl.h"
 #include "databasecommandloggable.h"
+#include "opcodec.h"
 #include "tomahawksqlquery.h"
+#include "network/msgcodec.h"
+#include "network/msg.h"
 #include "utils/logger.h"
 
 #ifndef QT_NO_DEBUG
     //#define DEBUG_TIMING TRUE
 #endif
 
+// the rw worker commits after this many mutating cmds or ms, whichever comes first
+#define WRITE_BATCH_SIZE 100
+#define WRITE_BATCH_TIMEOUT 100
+// how often we log the write batching stats, in ms
+#define WRITE_METRICS_INTERVAL 60000
+
 DatabaseWorker::DatabaseWorker( DatabaseImpl* lib, Database* db, bool mutates )
     : QThread()
     , m_dbimpl( lib )
+    , m_mutates( mutates )
     , m_outstanding( 0 )
+    , m_inTransaction( false )
+    , m_commandCount( 0 )
+    , m_commitCount( 0 )
 {
     Q_UNUSED( db );
-    Q_UNUSED( mutates );
+
+    // created before moveToThread, so it moves along with us
+    m_commitTimer = new QTimer( this );
+    m_commitTimer->setSingleShot( true );
+    connect( m_commitTimer, SIGNAL( timeout() ), SLOT( commitBatch() ) );
 
     moveToThread( this );
 
@@ -67,7 +84,20 @@ DatabaseWorker::~DatabaseWorker()
 void
 DatabaseWorker::run()
 {
+    // read-only workers get a connection of their own, so they don't have to queue up behind each other
+    if ( !m_mutates )
+        m_dbimpl->openThreadConnection();
+
+    m_metricsTime.start();
     exec();
+
+    // don't lose what's still waiting to be committed
+    commitBatch();
+
+    m_dbimpl->clearStatementCache();
+    if ( !m_mutates )
+        m_dbimpl->closeThreadConnection();
+
     qDebug() << Q_FUNC_INFO << "DatabaseWorker finishing...";
 }
 
@@ -105,6 +135,10 @@ DatabaseWorker::doWork()
         If the cmd is modifying local content (ie source->isLocal()) then
         log to the database oplog for replication to peers.
 
+        Mutating cmds are batched: the transaction stays open until
+        WRITE_BATCH_SIZE cmds ran or WRITE_BATCH_TIMEOUT ms passed, so we
+        don't pay for an fsync per cmd. Every cmd runs in a savepoint of its
+        own, a failing cmd only rolls back its own changes.
      */
 
 #ifdef DEBUG_TIMING
@@ -112,7 +146,6 @@ DatabaseWorker::doWork()
     timer.start();
 #endif
 
-    QList< QSharedPointer<DatabaseCommand> > cmdGroup;
     QSharedPointer<DatabaseCommand> cmd;
     {
         QMutexLocker lock( &m_mut );
@@ -121,93 +154,106 @@ DatabaseWorker::doWork()
 
     if ( cmd->doesMutates() )
     {
-        bool transok = m_dbimpl->database().transaction();
-        Q_ASSERT( transok );
-        Q_UNUSED( transok );
+        if ( !m_inTransaction )
+        {
+            bool transok = m_dbimpl->database().transaction();
+            Q_ASSERT( transok );
+            Q_UNUSED( transok );
+
+            // ids created from here on are only published once we have committed
+            m_dbimpl->idCache().beginTransaction();
+
+            m_inTransaction = true;
+            m_batchTime.start();
+        }
+
+        TomahawkSqlQuery savepoint = m_dbimpl->newquery();
+        savepoint.exec( "SAVEPOINT dbcmd" );
+        m_dbimpl->idCache().savepoint();
+
+        if ( execCommand( cmd ) )
+        {
+            savepoint.exec( "RELEASE dbcmd" );
+            m_dbimpl->idCache().releaseSavepoint();
+        }
+        else
+        {
+            savepoint.exec( "ROLLBACK TO dbcmd" );
+            savepoint.exec( "RELEASE dbcmd" );
+            m_dbimpl->idCache().rollbackToSavepoint();
+
+            // none of its changes got committed, so there's nothing for postCommit() to act on
+            m_rolledBack << cmd.data();
+        }
+
+        // even failed cmds get their finished() signal, in the order they were queued in
+        m_batch << cmd;
+        m_commandCount++;
+
+        if ( m_batch.count() >= WRITE_BATCH_SIZE || m_batchTime.elapsed() >= WRITE_BATCH_TIMEOUT )
+            commitBatch();
+    }
+    else
+    {
+        // finished() signals keep the order cmds were queued in, so the batch goes first
+        commitBatch();
+
+        execCommand( cmd );
+        cmd->emitFinished();
     }
 
-    unsigned int completed = 0;
+#ifdef DEBUG_TIMING
+    tDebug() << "DBCmd Duration:" << timer.elapsed() << "ms for" << cmd->commandname();
+#endif
+
+    QMutexLocker lock( &m_mut );
+    m_outstanding--;
+    if ( m_outstanding > 0 )
+        QTimer::singleShot( 0, this, SLOT( doWork() ) );
+    else if ( m_inTransaction && !m_commitTimer->isActive() )
+        m_commitTimer->start( qMax( 0, WRITE_BATCH_TIMEOUT - m_batchTime.elapsed() ) );
+}
+
+
+bool
+DatabaseWorker::execCommand( const QSharedPointer<DatabaseCommand>& cmd )
+{
     try
     {
-        bool finished = false;
+        cmd->_exec( m_dbimpl ); // runs actual SQL stuff
+
+        if ( cmd->loggable() )
         {
-            while ( !finished )
+            // We only save our own ops to the oplog, since incoming ops from peers
+            // are applied immediately.
+            //
+            // Crazy idea: if peers had keypairs and could sign ops/msgs, in theory it
+            // would be safe to sync ops for friend A from friend B's cache, if he saved them,
+            // which would mean you could get updates even if a peer was offline.
+            if ( cmd->source()->isLocal() && !cmd->localOnly() )
             {
-                completed++;
-                cmd->_exec( m_dbimpl ); // runs actual SQL stuff
-
-                if ( cmd->loggable() )
+                // save to op-log
+                DatabaseCommandLoggable* command = (DatabaseCommandLoggable*)cmd.data();
+                logOp( command );
+            }
+            else
+            {
+                // Make a note of the last guid we applied for this source
+                // so we can always request just the newer ops in future.
+                //
+                if ( !cmd->singletonCmd() )
                 {
-                    // We only save our own ops to the oplog, since incoming ops from peers
-                    // are applied immediately.
-                    //
-                    // Crazy idea: if peers had keypairs and could sign ops/msgs, in theory it
-                    // would be safe to sync ops for friend A from friend B's cache, if he saved them,
-                    // which would mean you could get updates even if a peer was offline.
-                    if ( cmd->source()->isLocal() && !cmd->localOnly() )
-                    {
-                        // save to op-log
-                        DatabaseCommandLoggable* command = (DatabaseCommandLoggable*)cmd.data();
-                        logOp( command );
-                    }
-                    else
-                    {
-                        // Make a note of the last guid we applied for this source
-                        // so we can always request just the newer ops in future.
-                        //
-                        if ( !cmd->singletonCmd() )
-                        {
-                            TomahawkSqlQuery query = m_dbimpl->newquery();
-                            query.prepare( "UPDATE source SET lastop = ? WHERE id = ?" );
-                            query.addBindValue( cmd->guid() );
-                            query.addBindValue( cmd->source()->id() );
-
-                            if ( !query.exec() )
-                            {
-                                throw "Failed to set lastop";
-                            }
-                        }
-                    }
-                }
+                    TomahawkSqlQuery query = m_dbimpl->newquery();
+                    query.prepare( "UPDATE source SET lastop = ? WHERE id = ?" );
+                    query.addBindValue( cmd->guid() );
+                    query.addBindValue( cmd->source()->id() );
 
-                cmdGroup << cmd;
-                if ( cmd->groupable() && !m_commands.isEmpty() )
-                {
-                    QMutexLocker lock( &m_mut );
-                    if ( m_commands.first()->groupable() )
-                    {
-                        cmd = m_commands.takeFirst();
-                    }
-                    else
+                    if ( !query.exec() )
                     {
-                        finished = true;
+                        throw "Failed to set lastop";
                     }
                 }
-                else
-                    finished = true;
             }
-
-            if ( cmd->doesMutates() )
-            {
-                qDebug() << "Committing" << cmd->commandname() << cmd->guid();
-                if ( !m_dbimpl->database().commit() )
-                {
-                    tDebug() << "FAILED TO COMMIT TRANSACTION*";
-                    throw "commit failed";
-                }
-            }
-
-#ifdef DEBUG_TIMING
-            uint duration = timer.elapsed();
-            tDebug() << "DBCmd Duration:" << duration << "ms, now running postcommit for" << cmd->commandname();
-#endif
-
-            foreach ( QSharedPointer<DatabaseCommand> c, cmdGroup )
-                c->postCommit();
-
-#ifdef DEBUG_TIMING
-            tDebug() << "Post commit finished in" << timer.elapsed() - duration << "ms for" << cmd->commandname();
-#endif
         }
     }
     catch( const char * msg )
@@ -220,28 +266,81 @@ DatabaseWorker::doWork()
                  << m_dbimpl->database().lastError().driverText()
                  << endl;
 
-        if ( cmd->doesMutates() )
-            m_dbimpl->database().rollback();
-
         Q_ASSERT( false );
+        return false;
     }
     catch(...)
     {
         qDebug() << "Uncaught exception processing dbcmd";
-        if ( cmd->doesMutates() )
+        if ( m_inTransaction )
+        {
             m_dbimpl->database().rollback();
+            m_dbimpl->idCache().rollback();
+            m_inTransaction = false;
+
+            // nothing of the batch got committed, don't report it as finished later on
+            m_batch.clear();
+            m_rolledBack.clear();
+        }
 
         Q_ASSERT( false );
         throw;
     }
 
-    foreach ( QSharedPointer<DatabaseCommand> c, cmdGroup )
+    return true;
+}
+
+
+void
+DatabaseWorker::commitBatch()
+{
+    m_commitTimer->stop();
+    if ( !m_inTransaction )
+        return;
+
+    m_inTransaction = false;
+
+    QList< QSharedPointer<DatabaseCommand> > batch = m_batch;
+    QSet< DatabaseCommand* > rolledBack = m_rolledBack;
+    m_batch.clear();
+    m_rolledBack.clear();
+
+    qDebug() << "Committing" << batch.count() << "db cmds, last one:" << batch.last()->commandname() << batch.last()->guid();
+    if ( m_dbimpl->database().commit() )
+    {
+        m_dbimpl->idCache().commit();
+        m_commitCount++;
+
+        foreach ( const QSharedPointer<DatabaseCommand>& c, batch )
+        {
+            if ( !rolledBack.contains( c.data() ) )
+                c->postCommit();
+        }
+    }
+    else
+    {
+        tLog() << "FAILED TO COMMIT TRANSACTION*"
+               << m_dbimpl->database().lastError().databaseText()
+               << m_dbimpl->database().lastError().driverText();
+
+        m_dbimpl->database().rollback();
+        m_dbimpl->idCache().rollback();
+        Q_ASSERT( false );
+    }
+
+    foreach ( const QSharedPointer<DatabaseCommand>& c, batch )
         c->emitFinished();
 
-    QMutexLocker lock( &m_mut );
-    m_outstanding -= completed;
-    if ( m_outstanding > 0 )
-        QTimer::singleShot( 0, this, SLOT( doWork() ) );
+    if ( m_metricsTime.elapsed() >= WRITE_METRICS_INTERVAL )
+    {
+        const float secs = m_metricsTime.elapsed() / 1000.0;
+        tDebug( LOGVERBOSE ) << "Write batching:" << m_commandCount / secs << "cmds/s," << m_commitCount / secs << "commits/s"
+                             << "(" << m_commandCount << "cmds in" << m_commitCount << "commits )";
+
+        m_commandCount = 0;
+        m_commitCount = 0;
+        m_metricsTime.restart();
+    }
 }
 
 
@@ -250,13 +349,14 @@ void
 DatabaseWorker::logOp( DatabaseCommandLoggable* command )
 {
     TomahawkSqlQuery oplogquery = m_dbimpl->newquery();
-    oplogquery.prepare( "INSERT INTO oplog(source, guid, command, singleton, compressed, json) "
-                        "VALUES(?, ?, ?, ?, ?, ?)" );
+    oplogquery.prepare( "INSERT INTO oplog(source, guid, command, singleton, compressed, binary, json) "
+                        "VALUES(?, ?, ?, ?, ?, ?, ?)" );
 
+    // DBSyncConnection turns it into JSON again for peers that don't support the binary encoding
     QVariantMap variant = QJson::QObjectHelper::qobject2qvariant( command );
-    QByteArray ba = m_serializer.serialize( variant );
+    QByteArray ba = OpCodec::encode( variant );
 
-//     qDebug() << "OP JSON:" << ba.isNull() << ba << "from:" << variant; // debug
+//     qDebug() << "OP:" << ba.isNull() << ba.toHex() << "from:" << variant; // debug
 
     bool compressed = false;
     if( ba.length() >= 512 )
@@ -265,7 +365,7 @@ DatabaseWorker::logOp( DatabaseCommandLoggable* command )
         // has to happen as part of the same transaction as the dbcmd.
         // (we are in a worker thread for RW dbcmds anyway, so it's ok)
         //qDebug() << "Compressing DB OP JSON, uncompressed size:" << ba.length();
-        ba = qCompress( ba, 9 );
+        ba = qCompress( ba, MsgCodec::levelFor( Msg::DBOP ) );
         compressed = true;
         //qDebug() << "Compressed DB OP JSON size:" << ba.length();
     }
@@ -292,7 +392,8 @@ DatabaseWorker::logOp( DatabaseCommandLoggable* command )
     oplogquery.bindValue( 2, command->commandname() );
     oplogquery.bindValue( 3, command->singletonCmd() );
     oplogquery.bindValue( 4, compressed );
-    oplogquery.bindValue( 5, ba );
+    oplogquery.bindValue( 5, true );
+    oplogquery.bindValue( 6, ba );
     if( !oplogquery.exec() )
     {
         tLog() << "Error saving to oplog";
@@ -23,7 +23,9 @@
 #include <QThread>
 #include <QMutex>
 #include <QList>
+#include <QSet>
 #include <QSharedPointer>
+#include <QTime>
 
 #include <qjson/parser.h>
 #include <qjson/serializer.h>
@@ -31,6 +33,7 @@
 
 #include "databasecommand.h"
 
+class QTimer;
 class Database;
 class DatabaseCommandLoggable;
 
@@ -54,16 +57,29 @@ protected:
 
 private slots:
     void doWork();
+    void commitBatch();
 
 private:
+    bool execCommand( const QSharedPointer<DatabaseCommand>& cmd );
     void logOp( DatabaseCommandLoggable* command );
 
     QMutex m_mut;
     DatabaseImpl* m_dbimpl;
+    bool m_mutates;
     QList< QSharedPointer<DatabaseCommand> > m_commands;
     int m_outstanding;
 
-    QJson::Serializer m_serializer;
+    // mutating cmds that ran in the currently open transaction
+    bool m_inTransaction;
+    QList< QSharedPointer<DatabaseCommand> > m_batch;
+    // cmds of the batch that got rolled back to their savepoint
+    QSet< DatabaseCommand* > m_rolledBack;
+    QTime m_batchTime;
+    QTimer* m_commitTimer;
+
+    QTime m_metricsTime;
+    unsigned int m_commandCount;
+    unsigned int m_commitCount;
 };
 
 #endif // DATABASEWORKER_H
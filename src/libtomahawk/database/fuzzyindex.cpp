@@ -23,7 +23,11 @@
 
 #include <CLucene.h>
 
+#include "database.h"
 #include "databaseimpl.h"
+#include "databasecommand_updatesearchindex.h"
+#include "ngramindex.h"
+#include "tomahawksettings.h"
 #include "utils/tomahawkutils.h"
 #include "utils/logger.h"
 
@@ -34,14 +38,27 @@ using namespace lucene::index;
 using namespace lucene::queryParser;
 using namespace lucene::search;
 
+// flush the long-lived index writer after this many added / deleted documents
+#define FLUSH_THRESHOLD 5000
+
 
 FuzzyIndex::FuzzyIndex( DatabaseImpl& db, bool wipeIndex )
     : QObject()
     , m_db( db )
+    , m_pendingChanges( 0 )
+    , m_luceneReaderStale( false )
+    , m_luceneWriter( 0 )
     , m_luceneReader( 0 )
     , m_luceneSearcher( 0 )
 {
-    QString m_lucenePath = TomahawkUtils::appDataDir().absoluteFilePath( "tomahawk.lucene" );
+    m_inMemory = TomahawkSettings::instance()->inMemorySearchIndex();
+    if ( m_inMemory )
+    {
+        tLog() << "Using in-memory fuzzy index";
+        m_ngramIndex = QSharedPointer< NGramIndex >( new NGramIndex() );
+    }
+
+    m_lucenePath = TomahawkUtils::appDataDir().absoluteFilePath( "tomahawk.lucene" );
     m_luceneDir = FSDirectory::getDirectory( m_lucenePath.toStdString().c_str() );
     m_analyzer = _CLNEW SimpleAnalyzer();
 
@@ -56,6 +73,17 @@ FuzzyIndex::FuzzyIndex( DatabaseImpl& db, bool wipeIndex )
 
 FuzzyIndex::~FuzzyIndex()
 {
+    try
+    {
+        if ( m_luceneWriter )
+            m_luceneWriter->close();
+    }
+    catch( CLuceneError& error )
+    {
+        tDebug() << "Caught CLucene error:" << error.what();
+    }
+
+    delete m_luceneWriter;
     delete m_luceneSearcher;
     delete m_luceneReader;
     delete m_analyzer;
@@ -66,24 +94,30 @@ FuzzyIndex::~FuzzyIndex()
 void
 FuzzyIndex::beginIndexing()
 {
+    if ( m_inMemory )
+    {
+        // build into a fresh index, searches keep using the old one until we're done
+        m_ngramIndexBuilding = QSharedPointer< NGramIndex >( new NGramIndex() );
+        return;
+    }
+
     m_mutex.lock();
 
     try
     {
         qDebug() << Q_FUNC_INFO << "Starting indexing.";
-        if ( m_luceneReader != 0 )
+        closeReader();
+
+        if ( m_luceneWriter )
         {
-            qDebug() << "Deleting old lucene stuff.";
-            m_luceneSearcher->close();
-            m_luceneReader->close();
-            delete m_luceneSearcher;
-            delete m_luceneReader;
-            m_luceneSearcher = 0;
-            m_luceneReader = 0;
+            m_luceneWriter->close();
+            delete m_luceneWriter;
+            m_luceneWriter = 0;
         }
 
         qDebug() << "Creating new index writer.";
-        IndexWriter luceneWriter = IndexWriter( m_luceneDir, m_analyzer, true );
+        m_luceneWriter = _CLNEW IndexWriter( m_luceneDir, m_analyzer, true );
+        m_pendingChanges = 0;
     }
     catch( CLuceneError& error )
     {
@@ -96,7 +130,21 @@ FuzzyIndex::beginIndexing()
 void
 FuzzyIndex::endIndexing()
 {
-    m_mutex.unlock();
+    if ( m_inMemory )
+    {
+        tLog( LOGVERBOSE ) << "In-memory fuzzy index built:" << m_ngramIndexBuilding->entryCount() << "entries,"
+                           << m_ngramIndexBuilding->memoryUsage() / 1024 << "KiB";
+
+        QWriteLocker lock( &m_ngramLock );
+        m_ngramIndex = m_ngramIndexBuilding;
+        m_ngramIndexBuilding.clear();
+    }
+    else
+    {
+        flushWriter();
+        m_mutex.unlock();
+    }
+
     emit indexReady();
 }
 
@@ -104,11 +152,93 @@ FuzzyIndex::endIndexing()
 void
 FuzzyIndex::appendFields( const QString& table, const QMap< unsigned int, QString >& fields )
 {
+    if ( m_inMemory )
+    {
+        Q_ASSERT( !m_ngramIndexBuilding.isNull() );
+        m_ngramIndexBuilding->addEntries( table, fields );
+        return;
+    }
+
+    // we're called between beginIndexing() and endIndexing(), which hold the mutex
+    addDocuments( table, fields );
+}
+
+
+void
+FuzzyIndex::updateFields( const QString& table, const QMap< unsigned int, QString >& fields )
+{
+    if ( fields.isEmpty() )
+        return;
+
+    if ( m_inMemory )
+    {
+        currentNGramIndex()->addEntries( table, fields );
+        return;
+    }
+
+    QMutexLocker lock( &m_mutex );
+
+    // replace documents we already have for these ids
+    deleteDocuments( table, fields.keys() );
+    addDocuments( table, fields );
+}
+
+
+void
+FuzzyIndex::deleteFields( const QString& table, const QList< unsigned int >& ids )
+{
+    if ( ids.isEmpty() )
+        return;
+
+    if ( m_inMemory )
+    {
+        currentNGramIndex()->removeEntries( table, ids );
+        return;
+    }
+
+    QMutexLocker lock( &m_mutex );
+    deleteDocuments( table, ids );
+}
+
+
+QString
+FuzzyIndex::documentKey( const QString& table, unsigned int id )
+{
+    return QString( "%1_%2" ).arg( table ).arg( id );
+}
+
+
+bool
+FuzzyIndex::openWriter()
+{
+    if ( m_luceneWriter )
+        return true;
+
+    try
+    {
+        const bool create = !IndexReader::indexExists( m_lucenePath.toStdString().c_str() );
+        m_luceneWriter = _CLNEW IndexWriter( m_luceneDir, m_analyzer, create );
+    }
+    catch( CLuceneError& error )
+    {
+        tDebug() << "Caught CLucene error:" << error.what();
+        Q_ASSERT( false );
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+FuzzyIndex::addDocuments( const QString& table, const QMap< unsigned int, QString >& fields )
+{
+    if ( !openWriter() )
+        return;
+
     try
     {
         qDebug() << "Appending to index:" << fields.count();
-        bool create = !IndexReader::indexExists( TomahawkUtils::appDataDir().absoluteFilePath( "tomahawk.lucene" ).toStdString().c_str() );
-        IndexWriter luceneWriter = IndexWriter( m_luceneDir, m_analyzer, create );
         Document doc;
 
         QMapIterator< unsigned int, QString > it( fields );
@@ -130,11 +260,19 @@ FuzzyIndex::appendFields( const QString& table, const QMap< unsigned int, QStrin
                 doc.add( *field );
             }
 
-            luceneWriter.addDocument( &doc );
+            {
+                Field* field = _CLNEW Field( _T( "key" ), documentKey( table, id ).toStdWString().c_str(),
+                Field::STORE_NO | Field::INDEX_UNTOKENIZED );
+                doc.add( *field );
+            }
+
+            m_luceneWriter->addDocument( &doc );
             doc.clear();
         }
 
-        luceneWriter.close();
+        m_pendingChanges += fields.count();
+        if ( m_pendingChanges >= FLUSH_THRESHOLD )
+            flushWriter();
     }
     catch( CLuceneError& error )
     {
@@ -144,9 +282,91 @@ FuzzyIndex::appendFields( const QString& table, const QMap< unsigned int, QStrin
 }
 
 
+void
+FuzzyIndex::deleteDocuments( const QString& table, const QList< unsigned int >& ids )
+{
+    if ( !openWriter() )
+        return;
+
+    try
+    {
+        foreach ( unsigned int id, ids )
+        {
+            Term* term = _CLNEW Term( _T( "key" ), documentKey( table, id ).toStdWString().c_str() );
+            m_luceneWriter->deleteDocuments( term );
+            _CLDECDELETE( term );
+        }
+
+        m_pendingChanges += ids.count();
+        if ( m_pendingChanges >= FLUSH_THRESHOLD )
+            flushWriter();
+    }
+    catch( CLuceneError& error )
+    {
+        tDebug() << "Caught CLucene error:" << error.what();
+        Q_ASSERT( false );
+    }
+}
+
+
+void
+FuzzyIndex::flushWriter()
+{
+    if ( !m_luceneWriter || !m_pendingChanges )
+        return;
+
+    try
+    {
+        tDebug( LOGVERBOSE ) << "Flushing" << m_pendingChanges << "changes to the fuzzy index";
+        m_luceneWriter->flush();
+        m_pendingChanges = 0;
+        m_luceneReaderStale = true;
+    }
+    catch( CLuceneError& error )
+    {
+        tDebug() << "Caught CLucene error:" << error.what();
+        Q_ASSERT( false );
+    }
+}
+
+
+void
+FuzzyIndex::closeReader()
+{
+    if ( m_luceneReader != 0 )
+    {
+        qDebug() << "Deleting old lucene stuff.";
+        m_luceneSearcher->close();
+        m_luceneReader->close();
+        delete m_luceneSearcher;
+        delete m_luceneReader;
+        m_luceneSearcher = 0;
+        m_luceneReader = 0;
+    }
+
+    m_luceneReaderStale = false;
+}
+
+
+QSharedPointer< NGramIndex >
+FuzzyIndex::currentNGramIndex()
+{
+    QReadLocker lock( &m_ngramLock );
+    return m_ngramIndex;
+}
+
+
 void
 FuzzyIndex::loadLuceneIndex()
 {
+    if ( m_inMemory )
+    {
+        // nothing is persisted, build the index from the database. endIndexing() emits indexReady
+        DatabaseCommand* cmd = new DatabaseCommand_UpdateSearchIndex();
+        Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
+        return;
+    }
+
     emit indexReady();
 }
 
@@ -154,14 +374,22 @@ FuzzyIndex::loadLuceneIndex()
 QMap< int, float >
 FuzzyIndex::search( const QString& table, const QString& name )
 {
+    if ( m_inMemory )
+        return currentNGramIndex()->search( table, name );
+
     QMutexLocker lock( &m_mutex );
 
     QMap< int, float > resultsmap;
     try
     {
+        // make pending changes visible and only reopen the reader if the index changed
+        flushWriter();
+        if ( m_luceneReaderStale )
+            closeReader();
+
         if ( !m_luceneReader )
         {
-            if ( !IndexReader::indexExists( TomahawkUtils::appDataDir().absoluteFilePath( "tomahawk.lucene" ).toStdString().c_str() ) )
+            if ( !m_luceneWriter && !IndexReader::indexExists( m_lucenePath.toStdString().c_str() ) )
             {
                 qDebug() << Q_FUNC_INFO << "index didn't exist.";
                 return resultsmap;
@@ -178,7 +406,8 @@ FuzzyIndex::search( const QString& table, const QString& name )
         QueryParser parser( table.toStdWString().c_str(), m_analyzer );
         Hits* hits = 0;
 
-        FuzzyQuery* qry = _CLNEW FuzzyQuery( _CLNEW Term( table.toStdWString().c_str(), DatabaseImpl::sortname( name ).toStdWString().c_str() ) );
+        const QString sortname = DatabaseImpl::sortname( name );
+        FuzzyQuery* qry = _CLNEW FuzzyQuery( _CLNEW Term( table.toStdWString().c_str(), sortname.toStdWString().c_str() ) );
         hits = m_luceneSearcher->search( qry );
 
         for ( uint i = 0; i < hits->length(); i++ )
@@ -189,7 +418,8 @@ FuzzyIndex::search( const QString& table, const QString& name )
             int id = QString::fromWCharArray( d->get( _T( "id" ) ) ).toInt();
             QString result = QString::fromWCharArray( d->get( table.toStdWString().c_str() ) );
 
-            if ( DatabaseImpl::sortname( result ) == DatabaseImpl::sortname( name ) )
+            // the index only holds sortnames already
+            if ( result == sortname )
                 score = 1.0;
             else
                 score = qMin( score, (float)0.99 );
@@ -24,6 +24,8 @@
 #include <QHash>
 #include <QString>
 #include <QMutex>
+#include <QReadWriteLock>
+#include <QSharedPointer>
 
 namespace lucene
 {
@@ -47,6 +49,7 @@ namespace lucene
 }
 
 class DatabaseImpl;
+class NGramIndex;
 
 class FuzzyIndex : public QObject
 {
@@ -59,7 +62,11 @@ public:
     void beginIndexing();
     void endIndexing();
     void appendFields( const QString& table, const QMap< unsigned int, QString >& fields );
-    
+
+    // incremental updates, keyed by the artist / album / track id
+    void updateFields( const QString& table, const QMap< unsigned int, QString >& fields );
+    void deleteFields( const QString& table, const QList< unsigned int >& ids );
+
 signals:
     void indexReady();
 
@@ -69,12 +76,33 @@ public slots:
     QMap< int, float > search( const QString& table, const QString& name );
 
 private:
+    static QString documentKey( const QString& table, unsigned int id );
+
+    bool openWriter();
+    void addDocuments( const QString& table, const QMap< unsigned int, QString >& fields );
+    void deleteDocuments( const QString& table, const QList< unsigned int >& ids );
+    void flushWriter();
+    void closeReader();
+
+    QSharedPointer< NGramIndex > currentNGramIndex();
+
     DatabaseImpl& m_db;
     QMutex m_mutex;
     QString m_lucenePath;
 
+    // in-memory backend, used instead of lucene if enabled in the settings
+    bool m_inMemory;
+    QReadWriteLock m_ngramLock; // only guards swapping the index pointers
+    QSharedPointer< NGramIndex > m_ngramIndex;
+    QSharedPointer< NGramIndex > m_ngramIndexBuilding;
+
+    // changes written since the last flush, the reader only gets reopened after a flush
+    unsigned int m_pendingChanges;
+    bool m_luceneReaderStale;
+
     lucene::analysis::SimpleAnalyzer* m_analyzer;
     lucene::store::Directory* m_luceneDir;
+    lucene::index::IndexWriter* m_luceneWriter;
     lucene::index::IndexReader* m_luceneReader;
     lucene::search::IndexSearcher* m_luceneSearcher;
 };
@@ -0,0 +1,191 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "idcache.h"
+
+#include <QSet>
+
+// entries per generation and table, so at most twice as many are cached
+#define MAX_IDS_PER_GENERATION 20000
+
+
+IdCache::IdCache()
+    : m_inTransaction( false )
+{
+}
+
+
+IdCache::~IdCache()
+{
+}
+
+
+QString
+IdCache::key( Table table, int artistid, const QString& sortname )
+{
+    if ( table == Artist )
+        return sortname;
+
+    return QString::number( artistid ) + '\t' + sortname;
+}
+
+
+int
+IdCache::find( Table table, const QString& key, bool mainConnection )
+{
+    QMutexLocker lock( &m_mutex );
+    Generations& g = m_tables[ table ];
+
+    QHash< QString, int >::const_iterator it = g.current.constFind( key );
+    if ( it != g.current.constEnd() )
+        return it.value();
+
+    it = g.previous.constFind( key );
+    if ( it != g.previous.constEnd() )
+    {
+        const int id = it.value();
+        g.previous.remove( key );
+        insertCommitted( table, key, id );
+        return id;
+    }
+
+    if ( mainConnection )
+        return m_pending[ table ].value( key, 0 );
+
+    return 0;
+}
+
+
+void
+IdCache::insert( Table table, const QString& key, int id, bool mainConnection )
+{
+    if ( id < 1 )
+        return;
+
+    QMutexLocker lock( &m_mutex );
+    if ( mainConnection && m_inTransaction )
+        m_pending[ table ].insert( key, id );
+    else
+        insertCommitted( table, key, id );
+}
+
+
+void
+IdCache::insertCommitted( Table table, const QString& key, int id )
+{
+    Generations& g = m_tables[ table ];
+    if ( g.current.count() >= MAX_IDS_PER_GENERATION )
+    {
+        g.previous = g.current;
+        g.current.clear();
+    }
+
+    g.current.insert( key, id );
+}
+
+
+void
+IdCache::forget( Table table, const QList< unsigned int >& ids )
+{
+    if ( ids.isEmpty() )
+        return;
+
+    QSet< int > idSet;
+    foreach ( unsigned int id, ids )
+        idSet << (int)id;
+
+    QMutexLocker lock( &m_mutex );
+    Generations& g = m_tables[ table ];
+    QHash< QString, int >* hashes[] = { &g.current, &g.previous, &m_pending[ table ] };
+    for ( int i = 0; i < 3; i++ )
+    {
+        QMutableHashIterator< QString, int > it( *hashes[i] );
+        while ( it.hasNext() )
+        {
+            if ( idSet.contains( it.next().value() ) )
+                it.remove();
+        }
+    }
+}
+
+
+void
+IdCache::beginTransaction()
+{
+    QMutexLocker lock( &m_mutex );
+    m_inTransaction = true;
+}
+
+
+void
+IdCache::commit()
+{
+    QMutexLocker lock( &m_mutex );
+    for ( int t = 0; t < 3; t++ )
+    {
+        QHash< QString, int >::const_iterator it = m_pending[t].constBegin();
+        for ( ; it != m_pending[t].constEnd(); ++it )
+            insertCommitted( (Table)t, it.key(), it.value() );
+
+        m_pending[t].clear();
+    }
+
+    m_inTransaction = false;
+}
+
+
+void
+IdCache::rollback()
+{
+    QMutexLocker lock( &m_mutex );
+    for ( int t = 0; t < 3; t++ )
+        m_pending[t].clear();
+
+    m_inTransaction = false;
+}
+
+
+void
+IdCache::savepoint()
+{
+    QMutexLocker lock( &m_mutex );
+    for ( int t = 0; t < 3; t++ )
+        m_savepoint[t] = m_pending[t];
+}
+
+
+void
+IdCache::releaseSavepoint()
+{
+    QMutexLocker lock( &m_mutex );
+    for ( int t = 0; t < 3; t++ )
+        m_savepoint[t].clear();
+}
+
+
+void
+IdCache::rollbackToSavepoint()
+{
+    // sqlite hands out the rolled back AUTOINCREMENT ids again, so they must not stay around
+    QMutexLocker lock( &m_mutex );
+    for ( int t = 0; t < 3; t++ )
+    {
+        m_pending[t] = m_savepoint[t];
+        m_savepoint[t].clear();
+    }
+}
@@ -0,0 +1,86 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDCACHE_H
+#define IDCACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+/*
+    Caches the ids of artist, album and track rows by sortname, so importing
+    a collection only hits the database once per distinct artist / album.
+
+    Every table keeps two generations of entries. Lookups promote hits from
+    the old generation, and when the current one is full it becomes the old
+    one, which evicts whatever hasn't been used since - a cheap approximation
+    of LRU.
+
+    Ids learned on the main connection while a write transaction is open may
+    still be rolled back. They are kept apart and are only visible to the
+    main connection until commit() publishes them; rollback() drops them.
+*/
+class IdCache
+{
+public:
+    enum Table
+    {
+        Artist = 0,
+        Album = 1,
+        Track = 2
+    };
+
+    IdCache();
+    ~IdCache();
+
+    // artistid is ignored for Artist lookups
+    static QString key( Table table, int artistid, const QString& sortname );
+
+    int find( Table table, const QString& key, bool mainConnection );
+    void insert( Table table, const QString& key, int id, bool mainConnection );
+    void forget( Table table, const QList< unsigned int >& ids );
+
+    void beginTransaction();
+    void commit();
+    void rollback();
+
+    // mirror the per-cmd SAVEPOINT of the rw worker, so ids of a rolled back cmd never get published
+    void savepoint();
+    void releaseSavepoint();
+    void rollbackToSavepoint();
+
+private:
+    struct Generations
+    {
+        QHash< QString, int > current;
+        QHash< QString, int > previous;
+    };
+
+    void insertCommitted( Table table, const QString& key, int id );
+
+    Generations m_tables[3];
+    QHash< QString, int > m_pending[3];
+    QHash< QString, int > m_savepoint[3];
+    bool m_inTransaction;
+
+    QMutex m_mutex;
+};
+
+#endif // IDCACHE_H
@@ -0,0 +1,288 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ngramindex.h"
+
+#include <QtAlgorithms>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+#include "databaseimpl.h"
+#include "utils/logger.h"
+
+// minimum dice coefficient of shared trigrams to consider an entry at all
+#define MIN_DICE 0.25
+// same as the default minimum similarity of a lucene FuzzyQuery
+#define MIN_SIMILARITY 0.5
+// same as lucene's default max clause count a FuzzyQuery gets expanded to
+#define MAX_CANDIDATES 1024
+
+
+static inline ushort
+gramChar( const QString& str, int i )
+{
+    return ( i < 0 || i >= str.length() ) ? 0 : str.at( i ).unicode();
+}
+
+
+static bool
+candidateSorter( const QPair< float, int >& left, const QPair< float, int >& right )
+{
+    return left.first > right.first;
+}
+
+
+NGramIndex::NGramIndex()
+{
+}
+
+
+NGramIndex::~NGramIndex()
+{
+}
+
+
+void
+NGramIndex::trigrams( const QString& str, QVector< quint64 >& grams )
+{
+    grams.clear();
+
+    // pad with two sentinels in front and one at the end, so matching prefixes weigh more
+    for ( int i = -2; i < str.length(); i++ )
+    {
+        grams << ( ( (quint64)gramChar( str, i ) << 32 ) |
+                   ( (quint64)gramChar( str, i + 1 ) << 16 ) |
+                   (quint64)gramChar( str, i + 2 ) );
+    }
+
+    qSort( grams.begin(), grams.end() );
+    grams.erase( std::unique( grams.begin(), grams.end() ), grams.end() );
+}
+
+
+int
+NGramIndex::editDistance( const QString& source, const QString& target )
+{
+    const int n = source.length();
+    const int m = target.length();
+
+    if ( n == 0 )
+        return m;
+    if ( m == 0 )
+        return n;
+
+    QVarLengthArray< int, 128 > prev( m + 1 );
+    QVarLengthArray< int, 128 > cur( m + 1 );
+    for ( int j = 0; j <= m; j++ )
+        prev[j] = j;
+
+    const QChar* s = source.constData();
+    const QChar* t = target.constData();
+    for ( int i = 1; i <= n; i++ )
+    {
+        cur[0] = i;
+        for ( int j = 1; j <= m; j++ )
+        {
+            const int cost = ( s[i - 1] == t[j - 1] ) ? 0 : 1;
+            cur[j] = qMin( qMin( prev[j] + 1, cur[j - 1] + 1 ), prev[j - 1] + cost );
+        }
+        prev = cur;
+    }
+
+    return prev[m];
+}
+
+
+void
+NGramIndex::addEntries( const QString& table, const QMap< unsigned int, QString >& fields )
+{
+    QWriteLocker lock( &m_lock );
+    Table& t = m_tables[ table ];
+
+    const int count = t.ids.count() + fields.count();
+    t.ids.reserve( count );
+    t.names.reserve( count );
+    t.gramCounts.reserve( count );
+
+    QVector< quint64 > grams;
+    QMapIterator< unsigned int, QString > it( fields );
+    while ( it.hasNext() )
+    {
+        it.next();
+
+        if ( t.slotForId.contains( it.key() ) )
+            removeSlot( t, t.slotForId.value( it.key() ) );
+
+        const int slot = t.ids.count();
+        const QString sortname = DatabaseImpl::sortname( it.value() );
+        trigrams( sortname, grams );
+
+        t.ids << it.key();
+        t.names << sortname;
+        t.gramCounts << (quint16)qMin( grams.count(), 0xffff );
+        t.slotForId.insert( it.key(), slot );
+
+        foreach ( quint64 gram, grams )
+            t.postings[ gram ] << slot;
+    }
+}
+
+
+void
+NGramIndex::removeEntries( const QString& table, const QList< unsigned int >& ids )
+{
+    QWriteLocker lock( &m_lock );
+    if ( !m_tables.contains( table ) )
+        return;
+
+    Table& t = m_tables[ table ];
+    foreach ( unsigned int id, ids )
+    {
+        if ( t.slotForId.contains( id ) )
+            removeSlot( t, t.slotForId.value( id ) );
+    }
+}
+
+
+void
+NGramIndex::removeSlot( Table& t, int slot )
+{
+    // postings keep pointing at the slot, search() skips it. a full rebuild compacts the table again
+    t.slotForId.remove( t.ids.at( slot ) );
+    t.names[ slot ] = QString();
+    t.gramCounts[ slot ] = 0;
+}
+
+
+QMap< int, float >
+NGramIndex::search( const QString& table, const QString& name ) const
+{
+    QMap< int, float > resultsmap;
+
+    const QString sortname = DatabaseImpl::sortname( name );
+    if ( sortname.isEmpty() )
+        return resultsmap;
+
+    QVector< quint64 > grams;
+    trigrams( sortname, grams );
+
+    QReadLocker lock( &m_lock );
+
+    QHash< QString, Table >::const_iterator tit = m_tables.constFind( table );
+    if ( tit == m_tables.constEnd() )
+        return resultsmap;
+    const Table& t = tit.value();
+
+    // count how many trigrams every entry shares with the query
+    QHash< int, int > shared;
+    foreach ( quint64 gram, grams )
+    {
+        QHash< quint64, QVector< int > >::const_iterator pit = t.postings.constFind( gram );
+        if ( pit == t.postings.constEnd() )
+            continue;
+
+        const int* slots = pit.value().constData();
+        const int c = pit.value().count();
+        for ( int i = 0; i < c; i++ )
+            shared[ slots[i] ]++;
+    }
+
+    QList< QPair< float, int > > candidates;
+    QHash< int, int >::const_iterator sit = shared.constBegin();
+    for ( ; sit != shared.constEnd(); ++sit )
+    {
+        if ( !t.gramCounts.at( sit.key() ) )
+            continue;
+
+        const float dice = 2.0 * sit.value() / ( grams.count() + t.gramCounts.at( sit.key() ) );
+        if ( dice >= MIN_DICE )
+            candidates << QPair< float, int >( dice, sit.key() );
+    }
+
+    qSort( candidates.begin(), candidates.end(), candidateSorter );
+    if ( candidates.count() > MAX_CANDIDATES )
+        candidates = candidates.mid( 0, MAX_CANDIDATES );
+
+    for ( int i = 0; i < candidates.count(); i++ )
+    {
+        const int slot = candidates.at( i ).second;
+        const QString& candidate = t.names.at( slot );
+
+        float score;
+        if ( candidate == sortname )
+        {
+            score = 1.0;
+        }
+        else
+        {
+            const int dist = editDistance( sortname, candidate );
+            score = 1.0 - (float)dist / qMin( sortname.length(), candidate.length() );
+            if ( score < MIN_SIMILARITY )
+                continue;
+
+            score = qMin( score, (float)0.99 );
+        }
+
+        if ( score > 0.05 )
+            resultsmap.insert( t.ids.at( slot ), score );
+    }
+
+    return resultsmap;
+}
+
+
+unsigned int
+NGramIndex::entryCount() const
+{
+    QReadLocker lock( &m_lock );
+
+    unsigned int count = 0;
+    foreach ( const Table& t, m_tables )
+        count += t.slotForId.count();
+
+    return count;
+}
+
+
+quint64
+NGramIndex::memoryUsage() const
+{
+    QReadLocker lock( &m_lock );
+
+    quint64 bytes = 0;
+    foreach ( const Table& t, m_tables )
+    {
+        bytes += t.ids.capacity() * sizeof( unsigned int );
+        bytes += t.gramCounts.capacity() * sizeof( quint16 );
+        bytes += t.slotForId.capacity() * ( sizeof( unsigned int ) + sizeof( int ) + 2 * sizeof( void* ) );
+        bytes += t.names.capacity() * sizeof( QString );
+        foreach ( const QString& name, t.names )
+            bytes += name.capacity() * sizeof( QChar );
+
+        QHash< quint64, QVector< int > >::const_iterator it = t.postings.constBegin();
+        for ( ; it != t.postings.constEnd(); ++it )
+        {
+            // hash node plus the vector's data block
+            bytes += sizeof( quint64 ) + sizeof( QVector< int > ) + 2 * sizeof( void* );
+            bytes += it.value().capacity() * sizeof( int );
+        }
+    }
+
+    return bytes;
+}
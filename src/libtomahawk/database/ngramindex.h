@@ -0,0 +1,75 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NGRAMINDEX_H
+#define NGRAMINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+/*
+    In-memory alternative to the CLucene backed FuzzyIndex.
+
+    Every sortname is split into trigrams, each trigram keeps a sorted array of
+    the entries containing it. A search counts shared trigrams to find
+    candidates and scores the best of them by edit distance, which gives the
+    same 0.05 - 1.0 score range the Lucene FuzzyQuery path produces.
+
+    Searches only take a read lock, so any number of db workers can search
+    concurrently.
+*/
+class NGramIndex
+{
+public:
+    NGramIndex();
+    ~NGramIndex();
+
+    // adds entries, replacing the ones we already have for the same ids
+    void addEntries( const QString& table, const QMap< unsigned int, QString >& fields );
+    void removeEntries( const QString& table, const QList< unsigned int >& ids );
+    QMap< int, float > search( const QString& table, const QString& name ) const;
+
+    unsigned int entryCount() const;
+    quint64 memoryUsage() const;
+
+private:
+    struct Table
+    {
+        // struct-of-arrays, indexed by slot. removed entries keep their slot with a gram count of 0
+        QVector< unsigned int > ids;
+        QVector< QString > names;
+        QVector< quint16 > gramCounts;
+        QHash< unsigned int, int > slotForId;
+
+        // trigram -> ascending list of slots
+        QHash< quint64, QVector< int > > postings;
+    };
+
+    static void removeSlot( Table& t, int slot );
+
+    static void trigrams( const QString& str, QVector< quint64 >& grams );
+    static int editDistance( const QString& source, const QString& target );
+
+    QHash< QString, Table > m_tables;
+    mutable QReadWriteLock m_lock;
+};
+
+#endif // NGRAMINDEX_H
@@ -29,6 +29,7 @@ struct DBOp
     QByteArray payload;
     bool compressed;
     bool singleton;
+    bool binary; // payload is encoded with OpCodec instead of JSON
 };
 
 typedef QSharedPointer<DBOp> dbop_ptr;
@@ -0,0 +1,404 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "opcodec.h"
+
+#include <QHash>
+#include <QStringList>
+#include <QtEndian>
+
+#include <limits.h>
+
+#include "utils/logger.h"
+
+#define FORMAT_VERSION 1
+// ops are maps of lists of maps, anything nested deeper than this is garbage
+#define MAX_DEPTH 32
+
+enum Tag
+{
+    TagInvalid = 0,
+    TagFalse,
+    TagTrue,
+    TagInt,      // zigzag varint
+    TagUInt,     // varint
+    TagDouble,   // 8 bytes, big endian
+    TagString,   // varint length + UTF-8
+    TagBytes,    // varint length + data
+    TagList,     // varint count + values
+    TagMap       // varint count + ( key, value ) pairs
+};
+
+// never reorder or remove any of these, peers and old oplog entries refer to them by index
+static const char* s_keys[] =
+{
+    "command", "guid", "files", "id", "url", "mtime", "size", "hash", "mimetype",
+    "duration", "bitrate", "artist", "album", "track", "albumpos", "year",
+    "ids", "deleteAll", "action", "comment", "timestamp", "playtime", "secsPlayed",
+    "trackDuration", "playlistguid", "playlistTitle", "playlist", "oldrev", "newrev",
+    "orderedguids", "addedentries", "annotation", "lastmodified", "query", "resulthint",
+    "title", "info", "creator", "createdon", "shared", "currentrevision", "controls",
+    "type", "mode", "del", "source"
+};
+
+
+#define KEY_COUNT ( sizeof( s_keys ) / sizeof( s_keys[0] ) )
+
+// built during static initialization, so it's read-only by the time any thread encodes
+class KeyIndexes : public QHash< QString, int >
+{
+public:
+    KeyIndexes()
+    {
+        for ( unsigned int i = 0; i < KEY_COUNT; i++ )
+            insert( QString::fromLatin1( s_keys[i] ), i );
+    }
+};
+
+static const KeyIndexes s_keyIndexes;
+
+
+static void
+writeVarint( QByteArray& out, quint64 v )
+{
+    while ( v >= 0x80 )
+    {
+        out.append( (char)( ( v & 0x7f ) | 0x80 ) );
+        v >>= 7;
+    }
+    out.append( (char)v );
+}
+
+
+static void
+writeString( QByteArray& out, const QString& s )
+{
+    const QByteArray utf8 = s.toUtf8();
+    writeVarint( out, utf8.length() );
+    out.append( utf8 );
+}
+
+
+static void
+writeKey( QByteArray& out, const QString& key )
+{
+    // 0 means the key follows inline, anything else is its index in s_keys + 1
+    QHash< QString, int >::const_iterator it = s_keyIndexes.constFind( key );
+    if ( it != s_keyIndexes.constEnd() )
+    {
+        writeVarint( out, it.value() + 1 );
+    }
+    else
+    {
+        writeVarint( out, 0 );
+        writeString( out, key );
+    }
+}
+
+
+static void
+writeValue( QByteArray& out, const QVariant& v )
+{
+    switch ( v.type() )
+    {
+        case QVariant::Invalid:
+            out.append( (char)TagInvalid );
+            break;
+
+        case QVariant::Bool:
+            out.append( (char)( v.toBool() ? TagTrue : TagFalse ) );
+            break;
+
+        case QVariant::Int:
+        case QVariant::LongLong:
+        {
+            const qint64 i = v.toLongLong();
+            out.append( (char)TagInt );
+            writeVarint( out, ( (quint64)i << 1 ) ^ (quint64)( i >> 63 ) );
+            break;
+        }
+
+        case QVariant::UInt:
+        case QVariant::ULongLong:
+            out.append( (char)TagUInt );
+            writeVarint( out, v.toULongLong() );
+            break;
+
+        case QVariant::Double:
+        {
+            const double d = v.toDouble();
+            quint64 bits;
+            memcpy( &bits, &d, sizeof( bits ) );
+
+            char be[ sizeof( bits ) ];
+            qToBigEndian( bits, (uchar*)be );
+            out.append( (char)TagDouble );
+            out.append( be, sizeof( be ) );
+            break;
+        }
+
+        case QVariant::ByteArray:
+        {
+            const QByteArray ba = v.toByteArray();
+            out.append( (char)TagBytes );
+            writeVarint( out, ba.length() );
+            out.append( ba );
+            break;
+        }
+
+        case QVariant::List:
+        case QVariant::StringList:
+        {
+            const QVariantList l = v.toList();
+            out.append( (char)TagList );
+            writeVarint( out, l.count() );
+            foreach ( const QVariant& item, l )
+                writeValue( out, item );
+            break;
+        }
+
+        case QVariant::Map:
+        {
+            const QVariantMap m = v.toMap();
+            out.append( (char)TagMap );
+            writeVarint( out, m.count() );
+
+            QVariantMap::const_iterator it = m.constBegin();
+            for ( ; it != m.constEnd(); ++it )
+            {
+                writeKey( out, it.key() );
+                writeValue( out, it.value() );
+            }
+            break;
+        }
+
+        default:
+            // same as the JSON serializer does for everything it doesn't know
+            out.append( (char)TagString );
+            writeString( out, v.toString() );
+            break;
+    }
+}
+
+
+class Reader
+{
+public:
+    Reader( const QByteArray& data )
+        : m_pos( (const uchar*)data.constData() )
+        , m_end( (const uchar*)data.constData() + data.length() )
+        , m_ok( true )
+    {
+    }
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_pos == m_end; }
+
+    uchar byte()
+    {
+        if ( m_pos >= m_end )
+            return fail();
+
+        return *m_pos++;
+    }
+
+    quint64 varint()
+    {
+        quint64 v = 0;
+        for ( int shift = 0; shift < 64; shift += 7 )
+        {
+            const uchar b = byte();
+            v |= (quint64)( b & 0x7f ) << shift;
+            if ( !( b & 0x80 ) )
+                return v;
+        }
+
+        return fail();
+    }
+
+    const char* take( quint64 length )
+    {
+        if ( (quint64)( m_end - m_pos ) < length )
+        {
+            fail();
+            return 0;
+        }
+
+        const char* p = (const char*)m_pos;
+        m_pos += length;
+        return p;
+    }
+
+    QString string()
+    {
+        const quint64 length = varint();
+        const char* p = take( length );
+        return p ? QString::fromUtf8( p, length ) : QString();
+    }
+
+    QString key()
+    {
+        const quint64 index = varint();
+        if ( index == 0 )
+            return string();
+
+        if ( index > KEY_COUNT )
+        {
+            fail();
+            return QString();
+        }
+
+        return QString::fromLatin1( s_keys[ index - 1 ] );
+    }
+
+    QVariant value( int depth )
+    {
+        if ( depth > MAX_DEPTH )
+        {
+            fail();
+            return QVariant();
+        }
+
+        switch ( byte() )
+        {
+            case TagInvalid:
+                return QVariant();
+
+            case TagFalse:
+                return false;
+
+            case TagTrue:
+                return true;
+
+            case TagInt:
+            {
+                const quint64 z = varint();
+                const qint64 i = (qint64)( z >> 1 ) ^ -(qint64)( z & 1 );
+                if ( i >= INT_MIN && i <= INT_MAX )
+                    return (int)i;
+                return i;
+            }
+
+            case TagUInt:
+            {
+                const quint64 u = varint();
+                if ( u <= UINT_MAX )
+                    return (uint)u;
+                return u;
+            }
+
+            case TagDouble:
+            {
+                const char* p = take( sizeof( quint64 ) );
+                if ( !p )
+                    return QVariant();
+
+                const quint64 bits = qFromBigEndian< quint64 >( (const uchar*)p );
+                double d;
+                memcpy( &d, &bits, sizeof( d ) );
+                return d;
+            }
+
+            case TagString:
+                return string();
+
+            case TagBytes:
+            {
+                const quint64 length = varint();
+                const char* p = take( length );
+                return p ? QByteArray( p, length ) : QByteArray();
+            }
+
+            case TagList:
+            {
+                const quint64 count = varint();
+                QVariantList l;
+                for ( quint64 i = 0; i < count && m_ok; i++ )
+                    l << value( depth + 1 );
+                return l;
+            }
+
+            case TagMap:
+            {
+                const quint64 count = varint();
+                QVariantMap m;
+                for ( quint64 i = 0; i < count && m_ok; i++ )
+                {
+                    const QString k = key();
+                    m.insert( k, value( depth + 1 ) );
+                }
+                return m;
+            }
+
+            default:
+                fail();
+                return QVariant();
+        }
+    }
+
+private:
+    uchar fail()
+    {
+        m_ok = false;
+        m_pos = m_end;
+        return 0;
+    }
+
+    const uchar* m_pos;
+    const uchar* m_end;
+    bool m_ok;
+};
+
+
+QByteArray
+OpCodec::encode( const QVariantMap& op )
+{
+    QByteArray out;
+    out.reserve( 256 );
+    out.append( (char)FORMAT_VERSION );
+    writeValue( out, op );
+
+    return out;
+}
+
+
+QVariant
+OpCodec::decode( const QByteArray& data )
+{
+    if ( !isEncoded( data ) )
+        return QVariant();
+
+    Reader r( data );
+    r.byte(); // version
+
+    const QVariant v = r.value( 0 );
+    if ( !r.ok() || !r.atEnd() )
+    {
+        tLog() << Q_FUNC_INFO << "Failed to decode op of" << data.length() << "bytes";
+        return QVariant();
+    }
+
+    return v;
+}
+
+
+bool
+OpCodec::isEncoded( const QByteArray& data )
+{
+    return !data.isEmpty() && data.at( 0 ) == FORMAT_VERSION;
+}
@@ -0,0 +1,48 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPCODEC_H
+#define OPCODEC_H
+
+#include <QByteArray>
+#include <QVariant>
+
+#include "dllmacro.h"
+
+/*
+    Compact binary encoding for ops, used in the oplog and for syncing with
+    peers that support it, instead of JSON.
+
+    Every value is a one byte type tag followed by its data. Integers and
+    lengths are varints, strings are UTF-8. Map keys are indexes into a
+    fixed table of the property names ops use, anything else is written out
+    inline. Encoded ops start with a version byte, which JSON ops never do.
+
+    The key table is part of the format: only ever append to it.
+*/
+class DLLEXPORT OpCodec
+{
+public:
+    static QByteArray encode( const QVariantMap& op );
+    // an invalid QVariant if data is corrupt
+    static QVariant decode( const QByteArray& data );
+
+    static bool isEncoded( const QByteArray& data );
+};
+
+#endif // OPCODEC_H
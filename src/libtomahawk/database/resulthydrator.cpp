@@ -0,0 +1,141 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resulthydrator.h"
+
+#include <QStringList>
+#include <QVariantMap>
+
+#include "databaseimpl.h"
+#include "tomahawksqlquery.h"
+#include "artist.h"
+#include "album.h"
+#include "result.h"
+#include "sourcelist.h"
+#include "utils/logger.h"
+
+// how many track ids we look up attributes for with a single statement
+#define ATTRIBUTE_CHUNK 500
+
+using namespace Tomahawk;
+
+
+ResultHydrator::ResultHydrator( DatabaseImpl* lib )
+    : m_lib( lib )
+{
+}
+
+
+ResultHydrator::~ResultHydrator()
+{
+    Q_ASSERT( m_pending.isEmpty() );
+}
+
+
+QString
+ResultHydrator::columns()
+{
+    return QString( "file.url, file.mtime, file.size, file.md5, file.mimetype, file.duration, file.bitrate, "
+                    "file_join.artist, file_join.album, file_join.track, "
+                    "artist.name as artname, "
+                    "album.name as albname, "
+                    "track.name as trkname, "
+                    "file.source, "
+                    "file_join.albumpos, "
+                    "artist.id as artid, "
+                    "album.id as albid" );
+}
+
+
+result_ptr
+ResultHydrator::result( const TomahawkSqlQuery& query )
+{
+    source_ptr s;
+    QString url = query.value( 0 ).toString();
+
+    if ( query.value( 13 ).toUInt() == 0 )
+    {
+        s = SourceList::instance()->getLocal();
+    }
+    else
+    {
+        s = SourceList::instance()->get( query.value( 13 ).toUInt() );
+        if ( s.isNull() )
+        {
+            qDebug() << "Could not find source" << query.value( 13 ).toUInt();
+            return result_ptr();
+        }
+
+        url = QString( "servent://%1\t%2" ).arg( s->userName() ).arg( url );
+    }
+
+    result_ptr result = Result::get( url );
+    artist_ptr artist = Artist::get( query.value( 15 ).toUInt(), query.value( 10 ).toString() );
+    album_ptr album = Album::get( query.value( 16 ).toUInt(), query.value( 11 ).toString(), artist );
+
+    result->setModificationTime( query.value( 1 ).toUInt() );
+    result->setSize( query.value( 2 ).toUInt() );
+    result->setMimetype( query.value( 4 ).toString() );
+    result->setDuration( query.value( 5 ).toUInt() );
+    result->setBitrate( query.value( 6 ).toUInt() );
+    result->setArtist( artist );
+    result->setAlbum( album );
+    result->setTrack( query.value( 12 ).toString() );
+    result->setAlbumPos( query.value( 14 ).toUInt() );
+    result->setTrackId( query.value( 9 ).toUInt() );
+    result->setCollection( s->collection() );
+
+    m_pending[ result->trackId() ] << result;
+    return result;
+}
+
+
+void
+ResultHydrator::loadAttributes()
+{
+    if ( m_pending.isEmpty() )
+        return;
+
+    QHash< unsigned int, QVariantMap > attributes;
+    QList< unsigned int > ids = m_pending.keys();
+    for ( int i = 0; i < ids.count(); i += ATTRIBUTE_CHUNK )
+    {
+        QStringList idsl;
+        for ( int j = i; j < qMin( i + ATTRIBUTE_CHUNK, ids.count() ); j++ )
+            idsl << QString::number( ids.at( j ) );
+
+        TomahawkSqlQuery query = m_lib->newquery();
+        query.prepare( QString( "SELECT id, k, v FROM track_attributes WHERE id IN (%1)" ).arg( idsl.join( "," ) ) );
+        query.exec();
+        while ( query.next() )
+        {
+            attributes[ query.value( 0 ).toUInt() ][ query.value( 1 ).toString() ] = query.value( 2 ).toString();
+        }
+    }
+
+    // tracks without any attributes still get theirs reset, just like the per-row lookups did
+    QHash< unsigned int, QList< result_ptr > >::const_iterator it = m_pending.constBegin();
+    for ( ; it != m_pending.constEnd(); ++it )
+    {
+        const QVariantMap attr = attributes.value( it.key() );
+        foreach ( const result_ptr& result, it.value() )
+            result->setAttributes( attr );
+    }
+
+    m_pending.clear();
+}
@@ -0,0 +1,63 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESULTHYDRATOR_H
+#define RESULTHYDRATOR_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include "typedefs.h"
+
+// how many columns of a row ResultHydrator::columns() takes up
+#define RESULT_COLUMNS 17
+
+class DatabaseImpl;
+class TomahawkSqlQuery;
+
+/*
+    Builds Results from file rows for the commands that produce them.
+
+    Queries select columns() first (joining file, file_join, artist, track
+    and album under those names) and may add columns of their own after it.
+    Attributes are not looked up per row: loadAttributes() fetches them for
+    every result built so far with one IN query per chunk of tracks.
+*/
+class ResultHydrator
+{
+public:
+    explicit ResultHydrator( DatabaseImpl* lib );
+    ~ResultHydrator();
+
+    static QString columns();
+
+    // the result for the current row, or a null pointer if its source is gone
+    Tomahawk::result_ptr result( const TomahawkSqlQuery& query );
+
+    // sets the attributes of all results built since the last call
+    void loadAttributes();
+
+private:
+    DatabaseImpl* m_lib;
+
+    // track id -> results waiting for their attributes
+    QHash< unsigned int, QList< Tomahawk::result_ptr > > m_pending;
+};
+
+#endif // RESULTHYDRATOR_H
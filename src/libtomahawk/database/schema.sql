@@ -9,7 +9,8 @@ CREATE TABLE IF NOT EXISTS oplog (
     command TEXT NOT NULL,
     singleton BOOLEAN NOT NULL,
     compressed BOOLEAN NOT NULL,
-    json TEXT NOT NULL
+    json TEXT NOT NULL,
+    binary BOOLEAN NOT NULL DEFAULT 'false' -- json holds an OpCodec encoded op
 );
 CREATE UNIQUE INDEX oplog_guid ON oplog(guid);
 CREATE INDEX oplog_source ON oplog(source);
@@ -292,4 +293,4 @@ CREATE TABLE IF NOT EXISTS settings (
     v TEXT NOT NULL DEFAULT ''
 );
 
-INSERT INTO settings(k,v) VALUES('schema_version', '27');
+INSERT INTO settings(k,v) VALUES('schema_version', '28');
@@ -1,5 +1,5 @@
 /*
-    This file was automatically generated from schema.sql on Wed Nov 16 22:47:16 EST 2011.
+    This file was automatically generated from schema.sql on Fri Oct 16 19:03:55 UTC 2026.
 */
 
 static const char * tomahawk_schema_sql = 
@@ -10,7 +10,8 @@ static const char * tomahawk_schema_sql =
 "    command TEXT NOT NULL,"
 "    singleton BOOLEAN NOT NULL,"
 "    compressed BOOLEAN NOT NULL,"
-"    json TEXT NOT NULL"
+"    json TEXT NOT NULL,"
+"    binary BOOLEAN NOT NULL DEFAULT 'false' "
 ");"
 "CREATE UNIQUE INDEX oplog_guid ON oplog(guid);"
 "CREATE INDEX oplog_source ON oplog(source);"
@@ -189,7 +190,7 @@ static const char * tomahawk_schema_sql =
 "    k TEXT NOT NULL PRIMARY KEY,"
 "    v TEXT NOT NULL DEFAULT ''"
 ");"
-"INSERT INTO settings(k,v) VALUES('schema_version', '27');"
+"INSERT INTO settings(k,v) VALUES('schema_version', '28');"
     ;
 
 const char * get_tomahawk_sql()
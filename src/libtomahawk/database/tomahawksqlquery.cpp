@@ -0,0 +1,97 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tomahawksqlquery.h"
+
+#include <QAtomicInt>
+
+// shared by the caches of all connections
+static QAtomicInt s_hits;
+static QAtomicInt s_misses;
+
+
+TomahawkSqlQueryCache::TomahawkSqlQueryCache( const QSqlDatabase& db )
+    : m_db( db )
+{
+}
+
+
+TomahawkSqlQueryCache::~TomahawkSqlQueryCache()
+{
+    clear();
+}
+
+
+TomahawkSqlQuery
+TomahawkSqlQueryCache::query( const QString& sql )
+{
+    QHash< QString, TomahawkSqlQuery >::iterator it = m_queries.find( sql );
+    if ( it != m_queries.end() )
+    {
+        s_hits.fetchAndAddRelaxed( 1 );
+
+        it.value().finish();
+        return it.value();
+    }
+
+    s_misses.fetchAndAddRelaxed( 1 );
+
+    // statements are cheap to re-prepare, simply start over instead of tracking usage
+    if ( m_queries.count() >= TOMAHAWK_STATEMENT_CACHE_SIZE )
+        clear();
+
+    TomahawkSqlQuery query( m_db );
+    query.prepare( sql );
+    m_queries.insert( sql, query );
+
+    return query;
+}
+
+
+void
+TomahawkSqlQueryCache::clear()
+{
+    QHash< QString, TomahawkSqlQuery >::iterator it = m_queries.begin();
+    for ( ; it != m_queries.end(); ++it )
+        it.value().finish();
+
+    m_queries.clear();
+}
+
+
+unsigned int
+TomahawkSqlQueryCache::hits()
+{
+    return (unsigned int)(int)s_hits;
+}
+
+
+unsigned int
+TomahawkSqlQueryCache::misses()
+{
+    return (unsigned int)(int)s_misses;
+}
+
+
+float
+TomahawkSqlQueryCache::hitRate()
+{
+    const unsigned int h = hits();
+    const unsigned int total = h + misses();
+    return total ? (float)h / total : 0.0;
+}
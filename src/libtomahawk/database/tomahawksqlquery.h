@@ -20,6 +20,7 @@
 #define TOMAHAWKSQLQUERY_H
 // subclass QSqlQuery so that it prints the error msg if a query fails
 
+#include <QHash>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QTime>
@@ -27,6 +28,8 @@
 #include "utils/logger.h"
 
 #define TOMAHAWK_QUERY_THRESHOLD 60
+// how many prepared statements a single connection keeps around
+#define TOMAHAWK_STATEMENT_CACHE_SIZE 64
 
 class TomahawkSqlQuery : public QSqlQuery
 {
@@ -76,4 +79,32 @@ private:
     }
 };
 
+
+/*
+    Keeps prepared statements of one connection around, so hot paths don't
+    make sqlite re-parse the same SQL over and over again. Bind all values
+    by position before every exec() and call finish() once you're done
+    reading, otherwise the statement keeps its read snapshot open.
+
+    Not thread-safe, just like the connection it belongs to.
+*/
+class TomahawkSqlQueryCache
+{
+public:
+    explicit TomahawkSqlQueryCache( const QSqlDatabase& db );
+    ~TomahawkSqlQueryCache();
+
+    // returns a prepared (and reset) query for sql, sharing the statement with earlier calls
+    TomahawkSqlQuery query( const QString& sql );
+    void clear();
+
+    static unsigned int hits();
+    static unsigned int misses();
+    static float hitRate();
+
+private:
+    QSqlDatabase m_db;
+    QHash< QString, TomahawkSqlQuery > m_queries;
+};
+
 #endif // TOMAHAWKSQLQUERY_H
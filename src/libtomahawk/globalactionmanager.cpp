@@ -444,7 +444,7 @@ GlobalActionManager::doQueueAdd( const QStringList& parts, const QList< QPair< Q
             query_ptr q = Query::get( artist, title, album, uuid(), false );
             if( !urlStr.isEmpty() )
                 q->setResultHint( urlStr );
-            Pipeline::instance()->resolve( q, true );
+            Pipeline::instance()->resolve( q, Pipeline::Interactive );
 
             handleOpenTrack( q );
             return true;
@@ -462,7 +462,7 @@ GlobalActionManager::doQueueAdd( const QStringList& parts, const QList< QPair< Q
                     query_ptr q = Query::get( QString(), info.baseName(), QString(), uuid(), false );
                     q->setResultHint( track.toString() );
 
-                    Pipeline::instance()->resolve( q, true );
+                    Pipeline::instance()->resolve( q, Pipeline::Interactive );
 
                     ViewManager::instance()->queue()->model()->append( q );
                     ViewManager::instance()->showQueue();
@@ -804,7 +804,7 @@ void
 GlobalActionManager::playNow( const query_ptr& q )
 {
 
-    Pipeline::instance()->resolve( q, true );
+    Pipeline::instance()->resolve( q, Pipeline::Interactive );
 
     m_waitingToPlay = q;
     q->setProperty( "playNow", true );
@@ -815,7 +815,7 @@ GlobalActionManager::playNow( const query_ptr& q )
 void
 GlobalActionManager::playOrQueueNow( const query_ptr& q )
 {
-    Pipeline::instance()->resolve( q, true );
+    Pipeline::instance()->resolve( q, Pipeline::Interactive );
 
     m_waitingToPlay = q;
     connect( q.data(), SIGNAL( resolvingFinished( bool ) ), this, SLOT( waitingForResolved( bool ) ) );
@@ -862,7 +862,7 @@ bool GlobalActionManager::handleBookmarkCommand(const QUrl& url)
         query_ptr q = Query::get( artist, title, album );
         if( !urlStr.isEmpty() )
             q->setResultHint( urlStr );
-        Pipeline::instance()->resolve( q, true );
+        Pipeline::instance()->resolve( q, Pipeline::Interactive );
 
         // now we add it to the special "bookmarks" playlist, creating it if it doesn't exist. if nothing is playing, start playing the track
         QSharedPointer< LocalCollection > col = SourceList::instance()->getLocal()->collection().dynamicCast< LocalCollection >();
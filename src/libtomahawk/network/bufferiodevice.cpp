@@ -19,20 +19,41 @@
 #include "bufferiodevice.h"
 
 #include <QCoreApplication>
+#include <QDir>
+#include <QTemporaryFile>
 #include <QThread>
 
 #include "utils/logger.h"
 
 // Msgs are framed, this is the size each msg we send containing audio data:
 #define BLOCKSIZE 4096
+// how much of a stream we keep in memory by default
+#define WINDOW_SIZE 8 * 1024 * 1024
+// blocks kept in memory behind the read position, for decoders seeking back a little
+#define BLOCKS_BEHIND 16
+// how far ahead of the read position we look for missing blocks
+#define READAHEAD_BLOCKS 64
 
 
-BufferIODevice::BufferIODevice( unsigned int size, QObject* parent )
+BufferIODevice::BufferIODevice( unsigned int size, QObject* parent, unsigned int blockSize )
     : QIODevice( parent )
+    , m_blockSize( blockSize ? blockSize : BLOCKSIZE )
+    , m_firstEmpty( 0 )
+    , m_spillToDisk( true )
+    , m_spill( 0 )
+    , m_lastRequest( -1 )
     , m_size( size )
     , m_received( 0 )
     , m_pos( 0 )
 {
+    setWindowSize( WINDOW_SIZE );
+    ensureBlocks( maxBlocks() );
+}
+
+
+BufferIODevice::~BufferIODevice()
+{
+    delete m_spill;
 }
 
 
@@ -68,7 +89,14 @@ BufferIODevice::seek( qint64 pos )
 
     int block = blockForPos( pos );
     if ( isBlockEmpty( block ) )
+    {
+        {
+            QMutexLocker lock( &m_mut );
+            m_lastRequest = block;
+        }
+
         emit blockRequest( block );
+    }
 
     m_pos = pos;
     qDebug() << "Finished seeking";
@@ -95,32 +123,121 @@ BufferIODevice::inputComplete( const QString& errmsg )
 
 
 void
-BufferIODevice::addData( int block, const QByteArray& ba )
+BufferIODevice::setWindowSize( qint64 bytes )
 {
+    QMutexLocker lock( &m_mut );
+    m_windowBlocks = qMax( (qint64)2 * BLOCKS_BEHIND, bytes / m_blockSize );
+}
+
+
+void
+BufferIODevice::setSpillToDisk( bool spill )
+{
+    QMutexLocker lock( &m_mut );
+    m_spillToDisk = spill;
+}
+
+
+void
+BufferIODevice::addData( int block, const QByteArray& ba, int offset )
+{
+    Q_ASSERT( offset >= 0 && offset <= ba.count() );
+    const int length = ba.count() - offset;
+
     {
         QMutexLocker lock( &m_mut );
 
-        while ( m_buffer.count() <= block )
-            m_buffer << QByteArray();
-
-        m_buffer.replace( block, ba );
+        ensureBlocks( block + 1 );
+        if ( length > 0 )
+        {
+            // blocks we get sent again after a seek don't add to the size
+            if ( !m_filled.testBit( block ) )
+                m_received += length;
+
+            Block b;
+            b.buffer = ba;
+            b.offset = offset;
+
+            m_filled.setBit( block );
+            m_available.setBit( block );
+            m_blocks.insert( block, b );
+            evict();
+        }
     }
 
     // If this was the last block of the transfer, check if we need to fill up gaps
     if ( block + 1 == maxBlocks() )
     {
-        if ( nextEmptyBlock() >= 0 )
+        const int gap = nextEmptyBlock();
+        if ( gap >= 0 )
         {
-            emit blockRequest( nextEmptyBlock() );
+            emit blockRequest( gap );
         }
     }
 
-    m_received += ba.count();
-    emit bytesWritten( ba.count() );
+    emit bytesWritten( length );
     emit readyRead();
 }
 
 
+void
+BufferIODevice::ensureBlocks( int count )
+{
+    if ( m_filled.size() >= count )
+        return;
+
+    m_filled.resize( count );
+    m_available.resize( count );
+    m_spilled.resize( count );
+}
+
+
+void
+BufferIODevice::evict()
+{
+    const int readBlock = blockForPos( m_pos );
+
+    while ( m_blocks.count() > m_windowBlocks )
+    {
+        // drop what the reader left behind first, then what's furthest ahead of it
+        QMap< int, Block >::iterator victim = m_blocks.begin();
+        if ( victim.key() >= readBlock - BLOCKS_BEHIND )
+        {
+            victim = m_blocks.end();
+            --victim;
+        }
+
+        const int block = victim.key();
+        const Block& b = victim.value();
+
+        if ( m_spillToDisk && !m_spill )
+        {
+            m_spill = new QTemporaryFile( QDir::tempPath() + QDir::separator() + "tomahawkstream_XXXXXX" );
+            if ( !m_spill->open() )
+            {
+                tLog() << "Could not open temp file to spill stream data to:" << m_spill->errorString();
+                delete m_spill;
+                m_spill = 0;
+                m_spillToDisk = false;
+            }
+        }
+
+        if ( m_spill && m_spill->seek( (qint64)block * m_blockSize ) && m_spill->write( b.data(), b.count() ) == b.count() )
+        {
+            m_spilled[ block ] = b.count();
+        }
+        else
+        {
+            // we have to ask our peer for it again, should we need it
+            m_spilled[ block ] = 0;
+            m_available.clearBit( block );
+        }
+
+        m_blocks.erase( victim );
+    }
+}
+
+
 qint64
 BufferIODevice::bytesAvailable() const
 {
@@ -136,14 +253,75 @@ BufferIODevice::readData( char* data, qint64 maxSize )
     if ( atEnd() )
         return 0;
 
-    QByteArray ba;
-    ba.append( getData( m_pos, maxSize ) );
-    m_pos += ba.count();
+    qint64 copied = 0;
+    int request = -1;
+    {
+        QMutexLocker lock( &m_mut );
+
+        while ( copied < maxSize && m_pos < m_size )
+        {
+            const qint64 n = copyBlock( blockForPos( m_pos ), offsetForPos( m_pos ), data + copied, maxSize - copied );
+            if ( n <= 0 )
+                break;
+
+            copied += n;
+            m_pos += n;
+        }
+
+        // ask for what's missing ahead before the reader runs into it
+        request = missingAhead();
+        if ( request == m_lastRequest )
+            request = -1;
+        else if ( request >= 0 )
+            m_lastRequest = request;
+    }
+
+    if ( request >= 0 )
+        emit blockRequest( request );
+
+//    qDebug() << Q_FUNC_INFO << maxSize << copied << 2;
+    return copied;
+}
+
+
+qint64
+BufferIODevice::copyBlock( int block, int offset, char* data, qint64 maxSize )
+{
+    if ( block >= m_available.size() || !m_available.testBit( block ) )
+        return 0;
+
+    QMap< int, Block >::const_iterator it = m_blocks.constFind( block );
+    if ( it != m_blocks.constEnd() )
+    {
+        const qint64 n = qMin( (qint64)it.value().count() - offset, maxSize );
+        if ( n <= 0 )
+            return 0;
+
+        memcpy( data, it.value().data() + offset, n );
+        return n;
+    }
+
+    const qint64 n = qMin( (qint64)m_spilled.at( block ) - offset, maxSize );
+    if ( n <= 0 || !m_spill || !m_spill->seek( (qint64)block * m_blockSize + offset ) )
+        return 0;
+
+    return qMax( (qint64)0, m_spill->read( data, n ) );
+}
+
+
+int
+BufferIODevice::missingAhead() const
+{
+    const int first = blockForPos( m_pos );
+    const int last = qMin( first + READAHEAD_BLOCKS, qMin( maxBlocks(), m_available.size() ) );
 
-//    qDebug() << Q_FUNC_INFO << maxSize << ba.count() << 2;
-    memcpy( data, ba.data(), ba.count() );
+    for ( int i = first; i < last; i++ )
+    {
+        if ( !m_available.testBit( i ) )
+            return i;
+    }
 
-    return ba.count();
+    return -1;
 }
 
 
@@ -180,7 +358,13 @@ BufferIODevice::clear()
     QMutexLocker lock( &m_mut );
 
     m_pos = 0;
-    m_buffer.clear();
+    m_received = 0;
+    m_firstEmpty = 0;
+    m_lastRequest = -1;
+    m_blocks.clear();
+    m_filled.fill( false );
+    m_available.fill( false );
+    m_spilled.fill( 0 );
 }
 
 
@@ -198,7 +382,7 @@ BufferIODevice::blockForPos( qint64 pos ) const
     // 4095 / 4096 -> block 0
     // 4096 / 4096 -> block 1
 
-    return pos / BLOCKSIZE;
+    return pos / m_blockSize;
 }
 
 
@@ -209,35 +393,32 @@ BufferIODevice::offsetForPos( qint64 pos ) const
     // 4095 % 4096 -> offset 4095
     // 4096 % 4096 -> offset 0
 
-    return pos % BLOCKSIZE;
+    return pos % m_blockSize;
 }
 
 
 int
 BufferIODevice::nextEmptyBlock() const
 {
-    int i = 0;
-    foreach( const QByteArray& ba, m_buffer )
-    {
-        if ( ba.isEmpty() )
-            return i;
+    QMutexLocker lock( &m_mut );
 
-        i++;
-    }
+    // blocks never go missing again once received, so we only ever have to move forward
+    while ( m_firstEmpty < m_filled.size() && m_filled.testBit( m_firstEmpty ) )
+        m_firstEmpty++;
 
-    if ( i == maxBlocks() )
+    if ( m_firstEmpty >= maxBlocks() )
         return -1;
 
-    return i;
+    return m_firstEmpty;
 }
 
 
 int
 BufferIODevice::maxBlocks() const
 {
-    int i = m_size / BLOCKSIZE;
+    int i = m_size / m_blockSize;
 
-    if ( ( m_size % BLOCKSIZE ) > 0 )
+    if ( ( m_size % m_blockSize ) > 0 )
         i++;
 
     return i;
@@ -247,33 +428,10 @@ BufferIODevice::maxBlocks() const
 bool
 BufferIODevice::isBlockEmpty( int block ) const
 {
-    if ( block >= m_buffer.count() )
-        return true;
-
-    return m_buffer.at( block ).isEmpty();
-}
-
-
-QByteArray
-BufferIODevice::getData( qint64 pos, qint64 size )
-{
-//    qDebug() << Q_FUNC_INFO << pos << size << 1;
-    QByteArray ba;
-    int block = blockForPos( pos );
-    int offset = offsetForPos( pos );
-
     QMutexLocker lock( &m_mut );
-    while( ba.count() < size )
-    {
-        if ( block > maxBlocks() )
-            break;
 
-        if ( isBlockEmpty( block ) )
-            break;
-
-        ba.append( m_buffer.at( block++ ).mid( offset ) );
-    }
+    if ( block >= m_available.size() )
+        return true;
 
-//    qDebug() << Q_FUNC_INFO << pos << size << 2;
-    return ba.left( size );
+    return !m_available.testBit( block );
 }
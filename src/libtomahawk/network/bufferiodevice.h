@@ -19,16 +19,32 @@
 #ifndef BUFFERIODEVICE_H
 #define BUFFERIODEVICE_H
 
+#include <QBitArray>
 #include <QIODevice>
+#include <QMap>
 #include <QMutexLocker>
 #include <QFile>
+#include <QVector>
 
+class QTemporaryFile;
+
+/*
+    Receive buffer for audio data streamed from a peer, block by block.
+
+    A bitmap tracks which blocks we received, so finding gaps is cheap. Only a
+    window of blocks around the read position stays in memory, the rest is
+    spilled to a temp file (or dropped and requested again once it's needed,
+    if spilling is disabled). Blocks missing just ahead of the read position
+    get requested before the reader runs into them.
+*/
 class BufferIODevice : public QIODevice
 {
 Q_OBJECT
 
 public:
-    explicit BufferIODevice( unsigned int size = 0, QObject* parent = 0 );
+    // blockSize 0 means the default, blockSize()
+    explicit BufferIODevice( unsigned int size = 0, QObject* parent = 0, unsigned int blockSize = 0 );
+    virtual ~BufferIODevice();
 
     virtual bool open( OpenMode mode );
     virtual void close();
@@ -41,7 +57,8 @@ public:
     virtual bool atEnd() const;
     virtual qint64 pos() const { return m_pos; }
 
-    void addData( int block, const QByteArray& ba );
+    // the block's data starts at offset, so it can stay in the buffer it arrived in
+    void addData( int block, const QByteArray& ba, int offset = 0 );
     void clear();
 
     OpenMode openMode() const { return QIODevice::ReadOnly | QIODevice::Unbuffered; }
@@ -50,8 +67,13 @@ public:
 
     virtual bool isSequential() const { return false; }
 
+    // size of the blocks peers send us
     static unsigned int blockSize();
 
+    // how much data we keep in memory, in bytes
+    void setWindowSize( qint64 bytes );
+    void setSpillToDisk( bool spill );
+
     int maxBlocks() const;
     int nextEmptyBlock() const;
     bool isBlockEmpty( int block ) const;
@@ -64,11 +86,38 @@ protected:
     virtual qint64 writeData( const char* data, qint64 maxSize );
 
 private:
+    struct Block
+    {
+        QByteArray buffer;
+        int offset;
+
+        const char* data() const { return buffer.constData() + offset; }
+        int count() const { return buffer.count() - offset; }
+    };
+
     int blockForPos( qint64 pos ) const;
     int offsetForPos( qint64 pos ) const;
-    QByteArray getData( qint64 pos, qint64 size );
 
-    QList<QByteArray> m_buffer;
+    // the following only get called with m_mut locked
+    void ensureBlocks( int count );
+    qint64 copyBlock( int block, int offset, char* data, qint64 maxSize );
+    void evict();
+    int missingAhead() const;
+
+    unsigned int m_blockSize;
+
+    QBitArray m_filled; // blocks we received, no matter if we still have them
+    QBitArray m_available; // blocks we can read right now, from memory or m_spill
+    mutable int m_firstEmpty; // no block before this one is missing
+    QMap< int, Block > m_blocks; // blocks held in memory
+    int m_windowBlocks;
+
+    bool m_spillToDisk;
+    QTemporaryFile* m_spill;
+    QVector< int > m_spilled; // length of each block in m_spill, 0 if not in there
+
+    int m_lastRequest;
+
     mutable QMutex m_mut; //const methods need to lock
     unsigned int m_size, m_received;
 
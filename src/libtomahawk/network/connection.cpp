@@ -64,6 +64,7 @@ Connection::Connection( Servent* parent )
 Connection::~Connection()
 {
     tDebug() << "DTOR connection (super)" << id() << thread() << m_sock.isNull();
+    logCodecStats();
     if( !m_sock.isNull() )
     {
 //        qDebug() << "deleteLatering sock" << m_sock;
@@ -449,6 +450,26 @@ Connection::bytesWritten( qint64 i )
     // if we are waiting to shutdown, and have sent all queued data, do actual shutdown:
     if ( m_do_shutdown && m_tx_bytes == m_tx_bytes_requested )
         actualShutdown();
+    else if ( i > 0 )
+        emit dataWritten( i );
+}
+
+
+void
+Connection::logCodecStats() const
+{
+    if( m_msgprocessor_out.packedBytes() )
+    {
+        tLog( LOGVERBOSE ) << id() << "Compressed" << m_msgprocessor_out.rawBytes() << "bytes to" << m_msgprocessor_out.packedBytes()
+                           << "- ratio:" << (float)m_msgprocessor_out.packedBytes() / m_msgprocessor_out.rawBytes()
+                           << "- took" << m_msgprocessor_out.codecUsecs() / 1000 << "ms";
+    }
+    if( m_msgprocessor_in.packedBytes() )
+    {
+        tLog( LOGVERBOSE ) << id() << "Uncompressed" << m_msgprocessor_in.packedBytes() << "bytes to" << m_msgprocessor_in.rawBytes()
+                           << "- ratio:" << (float)m_msgprocessor_in.packedBytes() / m_msgprocessor_in.rawBytes()
+                           << "- took" << m_msgprocessor_in.codecUsecs() / 1000 << "ms";
+    }
 }
 
 
@@ -82,10 +82,15 @@ public:
     bool isRunning() const { return m_sock != 0; }
 
     qint64 bytesSent() const { return m_tx_bytes; }
+    // what we were asked to send but didn't hand to the network yet, for flow control
+    int outgoingMsgsQueued() const { return m_msgprocessor_out.length(); }
+    qint64 outgoingBytesQueued() const { return m_sock.isNull() ? 0 : m_sock->bytesToWrite(); }
     qint64 bytesReceived() const { return m_rx_bytes; }
 
     void setMsgProcessorModeOut( quint32 m ) { m_msgprocessor_out.setMode( m ); }
     void setMsgProcessorModeIn( quint32 m ) { m_msgprocessor_in.setMode( m ); }
+    // compression ratio and time spent (un)compressing msgs on this connection
+    void logCodecStats() const;
 
     const QHostAddress peerIpAddress() const { return m_peerIpAddress; }
 
@@ -94,6 +99,7 @@ signals:
     void failed();
     void finished();
     void statsTick( qint64 tx_bytes_sec, qint64 rx_bytes_sec );
+    void dataWritten( qint64 bytes );
     void socketClosed();
     void socketErrored( QAbstractSocket::SocketError );
 
@@ -20,25 +20,62 @@
     Database syncing using the oplog table.
     =======================================
     Load the last GUID we applied for the peer, tell them it.
-    In return, they send us all new ops since that guid.
+    In return, they send us the next page of new ops since that guid.
 
-    We then apply those new ops to our cache of their data
+    We then apply those new ops to our cache of their data and ask for
+    the next page, starting at the last op we applied. When there's
+    nothing left they reply "ok".
 
     Synced.
 
+    Since every page is only requested once the previous one got applied,
+    a dropped connection resumes from the last op we actually saved.
+
+    On the very first sync we announce the "snapshot" capability. A peer
+    that supports it replies with a snapshot of its collection instead of
+    its entire oplog history. The snapshot gets paged like any other ops,
+    its intermediate ops are tagged with guids that tell the peer where to
+    continue from, and the last one with its latest guid, so the next
+    fetchops only returns what happened after that. Peers that don't know
+    about it simply ignore the flag and send their full oplog.
+
+    We also always announce "opdict1": a peer that supports it compresses
+    the JSON ops it sends us with MsgCodec's preset op dictionary, which even
+    works for the many small ops that aren't worth compressing otherwise.
+
+    And "binaryops": a peer that supports it sends its ops in the OpCodec
+    encoding they're stored in. Everyone else gets them as JSON.
+
 */
 
 #include "dbsyncconnection.h"
 
+#include <QTimer>
+
 #include "database/database.h"
 #include "database/databasecommand.h"
 #include "database/databasecommand_collectionstats.h"
 #include "database/databasecommand_loadops.h"
+#include "database/databasecommand_loadsnapshot.h"
+#include "database/opcodec.h"
 #include "remotecollection.h"
 #include "source.h"
 #include "sourcelist.h"
 #include "utils/logger.h"
 
+// how many ops we send per fetchops request
+#define OPS_PER_PAGE 1000
+// stop feeding the connection while this much is still waiting to go out
+#define MAX_QUEUED_OP_MSGS 64
+#define MAX_QUEUED_OP_BYTES ( 256 * 1024 )
+// wait this long before fetching ops again we failed to save, so a batch that keeps failing doesn't spin
+#define REFETCH_DELAY 5000
+
+// optional protocol features we announce in fetchops, on top of PROTOVER
+#define CAPABILITY_SNAPSHOT "snapshot"
+#define CAPABILITY_OPDICT "opdict1"
+#define CAPABILITY_BINARYOPS "binaryops"
+
 using namespace Tomahawk;
 
 
@@ -46,6 +83,7 @@ DBSyncConnection::DBSyncConnection( Servent* s, const source_ptr& src )
     : Connection( s )
     , m_source( src )
     , m_state( UNKNOWN )
+    , m_binaryOps( false )
 {
     qDebug() << Q_FUNC_INFO << src->id() << thread();
 
@@ -53,6 +91,8 @@ DBSyncConnection::DBSyncConnection( Servent* s, const source_ptr& src )
              m_source.data(),   SLOT( onStateChanged( DBSyncConnection::State, DBSyncConnection::State, QString ) ) );
     connect( m_source.data(), SIGNAL( commandsFinished() ),
              this,              SLOT( lastOpApplied() ) );
+    connect( m_source.data(), SIGNAL( commandsFailed() ),
+             this,              SLOT( lastOpFailed() ) );
 
     this->setMsgProcessorModeIn( MsgProcessor::PARSE_JSON | MsgProcessor::UNCOMPRESS_ALL );
 
@@ -85,6 +125,8 @@ void
 DBSyncConnection::setup()
 {
     setId( QString( "DBSyncConnection/%1" ).arg( socket()->peerAddress().toString() ) );
+    connect( this, SIGNAL( dataWritten( qint64 ) ), SLOT( sendPendingOps() ) );
+
     check();
 }
 
@@ -166,6 +208,16 @@ DBSyncConnection::fetchOpsData( const QString& sinceguid )
     QVariantMap msg;
     msg.insert( "method", "fetchops" );
     msg.insert( "lastop", sinceguid );
+
+    QVariantList capabilities;
+    capabilities << QString( CAPABILITY_OPDICT ) << QString( CAPABILITY_BINARYOPS );
+
+    // we don't have anything of theirs yet, a snapshot gets us there a lot faster than their oplog
+    if ( sinceguid.isEmpty() )
+        capabilities << QString( CAPABILITY_SNAPSHOT );
+
+    msg.insert( "capabilities", capabilities );
+
     sendMsg( msg );
 }
 
@@ -184,6 +236,7 @@ DBSyncConnection::handleMsg( msg_ptr msg )
          msg->payload() == "ok" )
     {
         changeState( SYNCED );
+        logCodecStats();
 
         // calc the collection stats, to updates the "X tracks" in the sidebar etc
         // this is done automatically if you run a dbcmd to add files.
@@ -194,7 +247,7 @@ DBSyncConnection::handleMsg( msg_ptr msg )
         return;
     }
 
-    Q_ASSERT( msg->is( Msg::JSON ) );
+    Q_ASSERT( msg->is( Msg::JSON ) || msg->isEncodedOp() );
 
     QVariantMap m = msg->json().toMap();
     if ( m.empty() )
@@ -224,6 +277,8 @@ DBSyncConnection::handleMsg( msg_ptr msg )
 
     if ( m.value( "method" ).toString() == "fetchops" )
     {
+        // they may ask for what we sent last once more, e.g. when they failed to save it
+        m_lastSentOp.clear();
         m_uscache = m;
         sendOps();
         return;
@@ -250,6 +305,15 @@ DBSyncConnection::lastOpApplied()
 }
 
 
+void
+DBSyncConnection::lastOpFailed()
+{
+    // Source already forgot the ops, check() gets our lastop from the db again
+    changeState( UNKNOWN );
+    QTimer::singleShot( REFETCH_DELAY, this, SLOT( check() ) );
+}
+
+
 /// request new copies of anything we've cached that is stale
 void
 DBSyncConnection::sendOps()
@@ -258,7 +322,30 @@ DBSyncConnection::sendOps()
 
     source_ptr src = SourceList::instance()->getLocal();
 
-    DatabaseCommand_loadOps* cmd = new DatabaseCommand_loadOps( src, m_uscache.value( "lastop" ).toString() );
+    const QVariantList capabilities = m_uscache.value( "capabilities" ).toList();
+    m_binaryOps = capabilities.contains( QString( CAPABILITY_BINARYOPS ) );
+
+    if ( capabilities.contains( QString( CAPABILITY_OPDICT ) ) )
+        setMsgProcessorModeOut( MsgProcessor::COMPRESS_IF_LARGE | MsgProcessor::COMPRESS_DBOPS );
+    else
+        setMsgProcessorModeOut( MsgProcessor::COMPRESS_IF_LARGE );
+
+    // they're either starting a snapshot or in the middle of one
+    const QString lastop = m_uscache.value( "lastop" ).toString();
+    if ( ( lastop.isEmpty() && capabilities.contains( QString( CAPABILITY_SNAPSHOT ) ) ) ||
+         DatabaseCommand_LoadSnapshot::isSnapshotGuid( lastop ) )
+    {
+        tLog() << "Sending peer" << m_source->id() << "a snapshot of our collection since:" << lastop;
+
+        DatabaseCommand_LoadSnapshot* cmd = new DatabaseCommand_LoadSnapshot( src, lastop, OPS_PER_PAGE );
+        connect( cmd, SIGNAL( done( QString, QString, QList< dbop_ptr > ) ),
+                        SLOT( sendOpsData( QString, QString, QList< dbop_ptr > ) ) );
+
+        Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
+        return;
+    }
+
+    DatabaseCommand_loadOps* cmd = new DatabaseCommand_loadOps( src, m_uscache.value( "lastop" ).toString(), OPS_PER_PAGE );
     connect( cmd, SIGNAL( done( QString, QString, QList< dbop_ptr > ) ),
                     SLOT( sendOpsData( QString, QString, QList< dbop_ptr > ) ) );
 
@@ -275,6 +362,8 @@ DBSyncConnection::sendOpsData( QString sinceguid, QString lastguid, QList< dbop_
     m_lastSentOp = lastguid;
     if ( ops.length() == 0 )
     {
+        m_pendingOps.clear();
+
         tLog( LOGVERBOSE ) << "Sending ok" << m_source->id() << m_source->friendlyName();
         sendMsg( Msg::factory( "ok", Msg::DBOP ) );
         return;
@@ -282,21 +371,54 @@ DBSyncConnection::sendOpsData( QString sinceguid, QString lastguid, QList< dbop_
 
     tLog( LOGVERBOSE ) << Q_FUNC_INFO << sinceguid << lastguid << "Num ops to send:" << ops.length();
 
-    int i;
-    for( i = 0; i < ops.length(); ++i )
+    // a new request supersedes whatever we didn't get to send yet
+    m_pendingOps = ops;
+    sendPendingOps();
+}
+
+
+void
+DBSyncConnection::sendPendingOps()
+{
+    while ( !m_pendingOps.isEmpty() &&
+            outgoingMsgsQueued() < MAX_QUEUED_OP_MSGS &&
+            outgoingBytesQueued() < MAX_QUEUED_OP_BYTES )
     {
-        quint8 flags = Msg::JSON | Msg::DBOP;
+        dbop_ptr op = m_pendingOps.takeFirst();
+        quint8 flags = Msg::DBOP;
+        QByteArray payload = op->payload;
 
-        if ( ops.at( i )->compressed )
-            flags |= Msg::COMPRESSED;
-        if ( i != ops.length() - 1 )
+        if ( op->binary && !m_binaryOps )
+        {
+            // our MsgProcessor compresses it again if it's worth it
+            payload = opToJson( op );
+            flags |= Msg::JSON;
+        }
+        else
+        {
+            flags |= op->binary ? Msg::RAW : Msg::JSON;
+            if ( op->compressed )
+                flags |= Msg::COMPRESSED;
+        }
+
+        if ( !m_pendingOps.isEmpty() )
             flags |= Msg::FRAGMENT;
 
-        sendMsg( Msg::factory( ops.at( i )->payload, flags ) );
+        sendMsg( Msg::factory( payload, flags ) );
     }
 }
 
 
+QByteArray
+DBSyncConnection::opToJson( const dbop_ptr& op )
+{
+    const QByteArray encoded = op->compressed ? qUncompress( op->payload ) : op->payload;
+
+    QJson::Serializer serializer;
+    return serializer.serialize( OpCodec::decode( encoded ) );
+}
+
+
 Connection*
 DBSyncConnection::clone()
 {
@@ -70,7 +70,9 @@ private slots:
 
     void fetchOpsData( const QString& sinceguid );
     void sendOpsData( QString sinceguid, QString lastguid, QList< dbop_ptr > ops );
+    void sendPendingOps();
     void lastOpApplied();
+    void lastOpFailed();
 
     void check();
 
@@ -78,12 +80,17 @@ private:
     void synced();
     void changeState( State newstate );
 
+    static QByteArray opToJson( const dbop_ptr& op );
+
     Tomahawk::source_ptr m_source;
     QVariantMap m_uscache;
 
     QString m_lastSentOp;
+    // ops of the current page that didn't fit into the outgoing queue yet
+    QList< dbop_ptr > m_pendingOps;
 
     State m_state;
+    bool m_binaryOps; // the peer we send ops to understands OpCodec
 };
 
 #endif // DBSYNCCONNECTION_H
@@ -23,6 +23,8 @@
     - 1 byte flags
 
     Flags indicate if the payload is compressed/json/etc.
+    DBOP msgs that are RAW instead of JSON carry an OpCodec encoded op,
+    json() decodes those just the same.
 
     Use static factory method to create, pass around shared pointers: msp_ptr
 */
@@ -34,11 +36,17 @@
 #include <QSharedPointer>
 #include <QtEndian>
 #include <QIODevice>
+#include <QVarLengthArray>
 
 #include <qjson/parser.h>
 #include <qjson/serializer.h>
 #include <qjson/qobjecthelper.h>
 
+#include "database/opcodec.h"
+
+// msgs up to this size get framed into one contiguous buffer on the stack
+#define MSG_MAX_COALESCED 8192
+
 class Msg;
 typedef QSharedPointer<Msg> msg_ptr;
 
@@ -55,7 +63,7 @@ public:
         COMPRESSED = 8,
         DBOP = 16,
         PING = 32,
-        RESERVED_1 = 64,
+        DICTIONARY = 64, // COMPRESSED with MsgCodec::opDictionary(), only sent to peers that support it
         SETUP = 128 // used to handshake/auth the connection prior to handing over to Connection subclass
     };
 
@@ -90,11 +98,22 @@ public:
     /// frames the msg and writes to the wire:
     bool write( QIODevice * device )
     {
-        quint32 size  = qToBigEndian( m_length );
-        quint8  flags = m_flags;
-        if( device->write( (const char*) &size,  sizeof(quint32) ) != sizeof(quint32) ) return false;
-        if( device->write( (const char*) &flags, sizeof(quint8) )  != sizeof(quint8)  ) return false;
-        if( device->write( (const char*) m_payload.data(), m_length ) != m_length ) return false;
+        char header[ sizeof(quint32) + sizeof(quint8) ];
+        qToBigEndian( m_length, (uchar*) header );
+        header[ sizeof(quint32) ] = m_flags;
+
+        // small msgs (all stream blocks) go out with a single write
+        if( m_length <= MSG_MAX_COALESCED )
+        {
+            QVarLengthArray< char, sizeof(header) + MSG_MAX_COALESCED > frame( sizeof(header) + m_length );
+            memcpy( frame.data(), header, sizeof(header) );
+            memcpy( frame.data() + sizeof(header), m_payload.constData(), m_length );
+            return device->write( frame.constData(), frame.size() ) == frame.size();
+        }
+
+        // big ones aren't worth copying, the socket buffers them anyway
+        if( device->write( header, sizeof(header) ) != sizeof(header) ) return false;
+        if( device->write( m_payload.constData(), m_length ) != m_length ) return false;
         return true;
     }
 
@@ -104,6 +123,7 @@ public:
     quint32 length() const { return m_length; }
 
     bool is( Flag flag ) { return m_flags & flag; }
+    bool isEncodedOp() { return is( DBOP ) && is( RAW ); }
 
     const QByteArray& payload() const
     {
@@ -113,14 +133,21 @@ public:
 
     QVariant& json()
     {
-        Q_ASSERT( is(JSON) );
+        Q_ASSERT( is(JSON) || isEncodedOp() );
         Q_ASSERT( !is(COMPRESSED) );
 
         if( !m_json_parsed )
         {
-            QJson::Parser p;
-            bool ok;
-            m_json = p.parse( m_payload, &ok );
+            if( isEncodedOp() )
+            {
+                m_json = OpCodec::decode( m_payload );
+            }
+            else
+            {
+                QJson::Parser p;
+                bool ok;
+                m_json = p.parse( m_payload, &ok );
+            }
             m_json_parsed = true;
         }
         return m_json;
@@ -135,7 +162,10 @@ private:
             m_length( ba.length() ),
             m_flags( f ),
             m_incomplete( false ),
-            m_json_parsed( false)
+            m_json_parsed( false),
+            m_rawLength( 0 ),
+            m_packedLength( 0 ),
+            m_codecUsecs( 0 )
     {
     }
 
@@ -144,7 +174,10 @@ private:
         :   m_length( len ),
             m_flags( flags ),
             m_incomplete( true ),
-            m_json_parsed( false)
+            m_json_parsed( false),
+            m_rawLength( 0 ),
+            m_packedLength( 0 ),
+            m_codecUsecs( 0 )
     {
     }
 
@@ -154,6 +187,11 @@ private:
     bool m_incomplete;
     QVariant m_json;
     bool m_json_parsed;
+
+    // set by MsgProcessor when it (un)compressed the payload, for its stats
+    quint32 m_rawLength;
+    quint32 m_packedLength;
+    quint32 m_codecUsecs;
 };
 
 #endif // MSG_H
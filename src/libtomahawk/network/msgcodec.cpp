@@ -0,0 +1,198 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "msgcodec.h"
+
+#include <QtEndian>
+
+#include <zlib.h>
+
+#include "msg.h"
+#include "utils/logger.h"
+
+// ops get compressed once, then stored and sent many times, worth some more effort.
+// level 9 costs a lot more CPU than this for a percent or two
+#define LEVEL_DBOP 6
+// everything else gets compressed right before sending it
+#define LEVEL_DEFAULT 1
+// refuse to allocate more than this for a single payload
+#define MAX_UNCOMPRESSED_LENGTH ( 64 * 1024 * 1024 )
+
+/*
+    The strings our op JSON (see DatabaseCommandLoggable and QJson::Serializer)
+    is made of, most frequent ones last. It's of no use for OpCodec's binary
+    ops, so those never get it. Peers need the exact same bytes to
+    uncompress, so this must never change: a new dictionary needs a new
+    capability in DBSyncConnection.
+*/
+static const char s_opDictionary[] =
+    "\"comment\" : \"\", \"timestamp\" : , \"secsPlayed\" : , \"trackDuration\" : , "
+    "\"playlistTitle\" : \"\", \"orderedguids\" : [ ], \"addedentries\" : [ ], \"controls\" : [ ], "
+    "\"createdon\" : , \"creator\" : \"\", \"currentrevision\" : \"\", \"info\" : \"\", \"shared\" : false, \"title\" : \"\", "
+    "\"oldrev\" : \"\", \"newrev\" : \"\", \"playlistguid\" : \"\", \"playlist\" : { "
+    "\"annotation\" : \"\", \"lastmodified\" : , \"resulthint\" : \"\", \"query\" : { "
+    "\"deleteAll\" : false, \"ids\" : [ "
+    "\"command\" : \"setplaylistrevision\", \"command\" : \"createplaylist\", \"command\" : \"deletefiles\", "
+    "\"command\" : \"socialaction\", \"action\" : \"Love\", \"command\" : \"logplayback\", \"action\" : 1, "
+    "\"mimetype\" : \"audio/mp4\", \"mimetype\" : \"application/ogg\", \"mimetype\" : \"audio/x-flac\", \"mimetype\" : \"audio/mpeg\", "
+    "\"command\" : \"addfiles\", \"files\" : [ { "
+    "\"year\" : 0, \"albumpos\" : , \"bitrate\" : 320, \"bitrate\" : 192, \"bitrate\" : 128, "
+    "\"duration\" : , \"hash\" : \"\", \"mtime\" : , \"size\" : , "
+    "\"url\" : \"\", \"album\" : \"\", \"artist\" : \"\", \"track\" : \"\", \"guid\" : \"\" }, { ";
+
+
+class ZlibCodec : public MsgCodec
+{
+public:
+    virtual QByteArray compress( const QByteArray& data, int level ) const
+    {
+        return qCompress( data, level );
+    }
+
+    virtual QByteArray uncompress( const QByteArray& data ) const
+    {
+        return qUncompress( data );
+    }
+};
+
+
+class DictionaryCodec : public MsgCodec
+{
+public:
+    DictionaryCodec( const char* dictionary, int length )
+        : m_dictionary( (const Bytef*)dictionary )
+        , m_length( length )
+    {
+    }
+
+    virtual QByteArray compress( const QByteArray& data, int level ) const
+    {
+        z_stream zs;
+        memset( &zs, 0, sizeof( zs ) );
+        if ( deflateInit( &zs, level ) != Z_OK )
+            return QByteArray();
+
+        if ( deflateSetDictionary( &zs, m_dictionary, m_length ) != Z_OK )
+        {
+            deflateEnd( &zs );
+            return QByteArray();
+        }
+
+        QByteArray out;
+        out.resize( 4 + deflateBound( &zs, data.length() ) );
+        qToBigEndian( (quint32)data.length(), (uchar*)out.data() );
+
+        zs.next_in = (Bytef*)data.constData();
+        zs.avail_in = data.length();
+        zs.next_out = (Bytef*)out.data() + 4;
+        zs.avail_out = out.length() - 4;
+
+        const int ret = deflate( &zs, Z_FINISH );
+        const int length = 4 + zs.total_out;
+        deflateEnd( &zs );
+
+        if ( ret != Z_STREAM_END )
+            return QByteArray();
+
+        out.resize( length );
+        return out;
+    }
+
+    virtual QByteArray uncompress( const QByteArray& data ) const
+    {
+        if ( data.length() < 4 )
+            return QByteArray();
+
+        const quint32 length = qFromBigEndian<quint32>( (const uchar*)data.constData() );
+        if ( length == 0 || length > MAX_UNCOMPRESSED_LENGTH )
+            return QByteArray();
+
+        z_stream zs;
+        memset( &zs, 0, sizeof( zs ) );
+        if ( inflateInit( &zs ) != Z_OK )
+            return QByteArray();
+
+        QByteArray out;
+        out.resize( length );
+
+        zs.next_in = (Bytef*)data.constData() + 4;
+        zs.avail_in = data.length() - 4;
+        zs.next_out = (Bytef*)out.data();
+        zs.avail_out = length;
+
+        int ret = inflate( &zs, Z_FINISH );
+        if ( ret == Z_NEED_DICT )
+        {
+            if ( inflateSetDictionary( &zs, m_dictionary, m_length ) == Z_OK )
+                ret = inflate( &zs, Z_FINISH );
+        }
+
+        const bool complete = ( ret == Z_STREAM_END && zs.total_out == length );
+        inflateEnd( &zs );
+
+        if ( !complete )
+        {
+            tLog() << Q_FUNC_INFO << "Failed to uncompress payload:" << ret;
+            return QByteArray();
+        }
+
+        return out;
+    }
+
+private:
+    const Bytef* m_dictionary;
+    uInt m_length;
+};
+
+
+static const ZlibCodec s_zlib;
+static const DictionaryCodec s_opDictionaryCodec( s_opDictionary, sizeof( s_opDictionary ) - 1 );
+
+
+const MsgCodec*
+MsgCodec::zlib()
+{
+    return &s_zlib;
+}
+
+
+const MsgCodec*
+MsgCodec::opDictionary()
+{
+    return &s_opDictionaryCodec;
+}
+
+
+const MsgCodec*
+MsgCodec::forFlags( char flags )
+{
+    if ( flags & Msg::DICTIONARY )
+        return opDictionary();
+
+    return zlib();
+}
+
+
+int
+MsgCodec::levelFor( char flags )
+{
+    if ( flags & Msg::DBOP )
+        return LEVEL_DBOP;
+
+    return LEVEL_DEFAULT;
+}
@@ -0,0 +1,56 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MSGCODEC_H
+#define MSGCODEC_H
+
+#include <QByteArray>
+
+#include "dllmacro.h"
+
+/*
+    Compression codecs for msg payloads.
+
+    The zlib codec is what qCompress / qUncompress do, every peer understands
+    it as Msg::COMPRESSED. The op dictionary codec is zlib primed with a preset
+    dictionary of the strings our op JSON is made of, so even small ops
+    compress well. Peers announce support for it when syncing, msgs using it
+    carry Msg::DICTIONARY on top of Msg::COMPRESSED.
+
+    Both produce the qCompress layout: the uncompressed length as 4 bytes big
+    endian, followed by a zlib stream.
+*/
+class DLLEXPORT MsgCodec
+{
+public:
+    virtual ~MsgCodec() {}
+
+    virtual QByteArray compress( const QByteArray& data, int level ) const = 0;
+    // a null QByteArray if data is corrupt
+    virtual QByteArray uncompress( const QByteArray& data ) const = 0;
+
+    static const MsgCodec* zlib();
+    static const MsgCodec* opDictionary();
+
+    // the codec a msg with these flags was compressed with
+    static const MsgCodec* forFlags( char flags );
+    // how hard to try for a msg with these flags
+    static int levelFor( char flags );
+};
+
+#endif // MSGCODEC_H
@@ -18,12 +18,30 @@
 
 #include "msgprocessor.h"
 
+#include <QElapsedTimer>
+
+#include "network/msgcodec.h"
 #include "network/servent.h"
 #include "utils/logger.h"
 
+// DBOP msgs shorter than this don't get anything out of compression
+#define MIN_DICTIONARY_LENGTH 64
+
+
+static quint32
+elapsedUsecs( const QElapsedTimer& timer )
+{
+#if QT_VERSION >= 0x040800
+    return timer.nsecsElapsed() / 1000;
+#else
+    return timer.elapsed() * 1000;
+#endif
+}
+
 
 MsgProcessor::MsgProcessor( quint32 mode, quint32 t ) :
-    QObject(), m_mode( mode ), m_threshold( t ), m_totmsgsize( 0 )
+    QObject(), m_mode( mode ), m_threshold( t ), m_totmsgsize( 0 ),
+    m_rawBytes( 0 ), m_packedBytes( 0 ), m_codecUsecs( 0 )
 {
     moveToThread( Servent::instance()->thread() );
 }
@@ -44,9 +62,9 @@ MsgProcessor::append( msg_ptr msg )
 
     m_totmsgsize += msg->payload().length();
 
-    if( m_mode & NOTHING )
+    // most msgs (e.g. all stream blocks) don't need any work, skip the round trip through the thread pool
+    if( !needsProcessing( msg, m_mode, m_threshold ) )
     {
-        //qDebug() << "MsgProcessor::NOTHING";
         handleProcessedMsg( msg );
         return;
     }
@@ -78,6 +96,13 @@ MsgProcessor::handleProcessedMsg( msg_ptr msg )
 
     m_msg_ready.insert( msg.data(), true );
 
+    if( msg->m_packedLength )
+    {
+        m_rawBytes += msg->m_rawLength;
+        m_packedBytes += msg->m_packedLength;
+        m_codecUsecs += msg->m_codecUsecs;
+    }
+
     while( !m_msgs.isEmpty() )
     {
         if( m_msg_ready.value( m_msgs.first().data() ) )
@@ -98,40 +123,76 @@ MsgProcessor::handleProcessedMsg( msg_ptr msg )
 }
 
 
+bool
+MsgProcessor::needsProcessing( const msg_ptr& msg, quint32 mode, quint32 threshold )
+{
+    if( (mode & UNCOMPRESS_ALL) && msg->is( Msg::COMPRESSED ) )
+        return true;
+
+    if( (mode & PARSE_JSON) && ( msg->is( Msg::JSON ) || msg->isEncodedOp() ) && msg->m_json_parsed == false )
+        return true;
+
+    if( !msg->is( Msg::COMPRESSED ) && (mode & COMPRESS_IF_LARGE) && msg->length() > threshold )
+        return true;
+
+    if( !msg->is( Msg::COMPRESSED ) && (mode & COMPRESS_DBOPS) && msg->is( Msg::DBOP ) && !msg->isEncodedOp() &&
+        msg->length() >= MIN_DICTIONARY_LENGTH )
+        return true;
+
+    return false;
+}
+
+
 /// This method is run by QtConcurrent:
 msg_ptr
 MsgProcessor::process( msg_ptr msg, quint32 mode, quint32 threshold )
 {
+    QElapsedTimer timer;
+
     // uncompress if needed
     if( (mode & UNCOMPRESS_ALL) && msg->is( Msg::COMPRESSED ) )
     {
 //        qDebug() << "MsgProcessor::UNCOMPRESSING";
-        msg->m_payload = qUncompress( msg->payload() );
+        timer.start();
+        msg->m_packedLength = msg->m_length;
+        msg->m_payload = MsgCodec::forFlags( msg->flags() )->uncompress( msg->payload() );
         msg->m_length  = msg->m_payload.length();
-        msg->m_flags ^= Msg::COMPRESSED;
+        msg->m_flags &= ~( Msg::COMPRESSED | Msg::DICTIONARY );
+        msg->m_rawLength = msg->m_length;
+        msg->m_codecUsecs = elapsedUsecs( timer );
     }
 
-    // parse json payload into qvariant if needed
+    // parse json payload (or decode a binary op) into qvariant if needed
     if( (mode & PARSE_JSON) &&
-        msg->is( Msg::JSON ) &&
+        ( msg->is( Msg::JSON ) || msg->isEncodedOp() ) &&
         msg->m_json_parsed == false )
     {
 //        qDebug() << "MsgProcessor::PARSING JSON";
-        bool ok;
-        QJson::Parser parser;
-        msg->m_json = parser.parse( msg->payload(), &ok );
-        msg->m_json_parsed = true;
+        msg->json();
     }
 
-    // compress if needed
-    if( (mode & COMPRESS_IF_LARGE) &&
-        !msg->is( Msg::COMPRESSED )
-        && msg->length() > threshold )
+    // compress if needed, JSON ops with the dictionary if the peer knows it.
+    // It's made of JSON strings, binary ops only get plain zlib once they're large
+    const bool dictionary = (mode & COMPRESS_DBOPS) &&
+                            msg->is( Msg::DBOP ) &&
+                            !msg->isEncodedOp() &&
+                            msg->length() >= MIN_DICTIONARY_LENGTH;
+    if( !msg->is( Msg::COMPRESSED ) &&
+        ( dictionary || ( (mode & COMPRESS_IF_LARGE) && msg->length() > threshold ) ) )
     {
 //        qDebug() << "MsgProcessor::COMPRESSING";
-        msg->m_payload = qCompress( msg->payload(), 9 );
-        msg->m_length  = msg->m_payload.length();
-        msg->m_flags |= Msg::COMPRESSED;
+        timer.start();
+        const MsgCodec* codec = dictionary ? MsgCodec::opDictionary() : MsgCodec::zlib();
+        const QByteArray compressed = codec->compress( msg->payload(), MsgCodec::levelFor( msg->flags() ) );
+        if( !compressed.isEmpty() )
+        {
+            msg->m_rawLength = msg->m_length;
+            msg->m_payload = compressed;
+            msg->m_length  = msg->m_payload.length();
+            msg->m_flags |= dictionary ? ( Msg::COMPRESSED | Msg::DICTIONARY ) : Msg::COMPRESSED;
+            msg->m_packedLength = msg->m_length;
+            msg->m_codecUsecs = elapsedUsecs( timer );
+        }
     }
     return msg;
 }
@@ -50,7 +50,8 @@ public:
         NOTHING = 0,
         COMPRESS_IF_LARGE = 1,
         UNCOMPRESS_ALL = 2,
-        PARSE_JSON = 4
+        PARSE_JSON = 4,
+        COMPRESS_DBOPS = 8 // compress DBOP msgs with the op dictionary, for peers that support it
     };
 
     explicit MsgProcessor( quint32 mode = NOTHING, quint32 t = 512 );
@@ -58,9 +59,16 @@ public:
     void setMode( quint32 m ) { m_mode = m ; }
 
     static msg_ptr process( msg_ptr msg, quint32 mode, quint32 threshold );
+    static bool needsProcessing( const msg_ptr& msg, quint32 mode, quint32 threshold );
 
     int length() const { return m_msgs.length(); }
 
+    // payload bytes before compressing (or after uncompressing), after compressing
+    // (or before uncompressing), and how long it took all in all
+    quint64 rawBytes() const { return m_rawBytes; }
+    quint64 packedBytes() const { return m_packedBytes; }
+    quint64 codecUsecs() const { return m_codecUsecs; }
+
 signals:
     void ready( msg_ptr );
     void empty();
@@ -77,6 +85,10 @@ private:
     QList<msg_ptr> m_msgs;
     QMap< Msg*, bool> m_msg_ready;
     unsigned int m_totmsgsize;
+
+    quint64 m_rawBytes;
+    quint64 m_packedBytes;
+    quint64 m_codecUsecs;
 };
 
 #endif // MSGPROCESSOR_H
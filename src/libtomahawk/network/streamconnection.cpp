@@ -25,11 +25,22 @@
 #include "bufferiodevice.h"
 #include "network/controlconnection.h"
 #include "network/servent.h"
+#include "network/uploadthrottle.h"
 #include "database/databasecommand_loadfiles.h"
 #include "database/database.h"
 #include "sourcelist.h"
 #include "utils/logger.h"
 
+// we stop reading from the file while the socket has this much left to write
+#define MAX_QUEUED_BYTES ( 256 * 1024 )
+// blocks we send in one go, adapted to how fast the socket drains
+#define MIN_BURST_BLOCKS 1
+#define MAX_BURST_BLOCKS 32
+// how long we wait for upload budget when we ran out of it
+#define THROTTLE_INTERVAL 50
+// enough buffers for everything we let queue up plus one burst
+#define BLOCK_POOL_SIZE ( MAX_QUEUED_BYTES / 4096 + MAX_BURST_BLOCKS )
+
 using namespace Tomahawk;
 
 
@@ -42,6 +53,10 @@ StreamConnection::StreamConnection( Servent* s, ControlConnection* cc, QString f
     , m_badded( 0 )
     , m_bsent( 0 )
     , m_allok( false )
+    , m_burst( MIN_BURST_BLOCKS )
+    , m_throttled( false )
+    , m_throttleRegistered( false )
+    , m_poolPos( 0 )
     , m_result( result )
     , m_transferRate( 0 )
 {
@@ -75,11 +90,18 @@ StreamConnection::StreamConnection( Servent* s, ControlConnection* cc, QString f
     , m_badded( 0 )
     , m_bsent( 0 )
     , m_allok( false )
+    , m_burst( MIN_BURST_BLOCKS )
+    , m_throttled( false )
+    , m_throttleRegistered( false )
+    , m_poolPos( 0 )
     , m_transferRate( 0 )
 {
     Servent::instance()->registerStreamConnection( this );
     // auto delete when connection closes:
     connect( this, SIGNAL( finished() ), SLOT( deleteLater() ), Qt::QueuedConnection );
+
+    // the socket got rid of some data, we can send more
+    connect( this, SIGNAL( dataWritten( qint64 ) ), SLOT( sendSome() ) );
 }
 
 
@@ -97,6 +119,9 @@ StreamConnection::~StreamConnection()
         ((BufferIODevice*)m_iodev.data())->inputComplete();
     }
 
+    if ( m_throttleRegistered )
+        UploadThrottle::instance()->removeSender( m_cc );
+
     Servent::instance()->onStreamFinished( this );
 }
 
@@ -186,6 +211,9 @@ StreamConnection::startSending( const Tomahawk::result_ptr& result )
     }
 
     m_readdev = QSharedPointer<QIODevice>( io );
+
+    UploadThrottle::instance()->addSender( m_cc );
+    m_throttleRegistered = true;
     sendSome();
 
     emit updated();
@@ -221,7 +249,7 @@ StreamConnection::handleMsg( msg_ptr msg )
     else if ( msg->payload().startsWith( "data" ) )
     {
         m_badded += msg->payload().length() - 4;
-        ((BufferIODevice*)m_iodev.data())->addData( m_curBlock++, msg->payload().mid( 4 ) );
+        ((BufferIODevice*)m_iodev.data())->addData( m_curBlock++, msg->payload(), 4 );
     }
 
     //qDebug() << Q_FUNC_INFO << "flags" << (int) msg->flags()
@@ -251,27 +279,81 @@ StreamConnection::sendSome()
 {
     Q_ASSERT( m_type == StreamConnection::SENDING );
 
-    QByteArray ba = "data";
-    ba.append( m_readdev->read( BufferIODevice::blockSize() ) );
-    m_bsent += ba.length() - 4;
+    // dataWritten also gets us here before we have anything to send and after we sent it all
+    if ( m_readdev.isNull() || m_readdev->atEnd() )
+        return;
+
+    const qint64 blockSize = BufferIODevice::blockSize();
 
-    if( m_readdev->atEnd() )
+    // don't read the file into the socket's buffer faster than it gets written out
+    const qint64 queued = outgoingBytesQueued() + outgoingMsgsQueued() * blockSize;
+    if ( queued >= MAX_QUEUED_BYTES )
     {
-        sendMsg( Msg::factory( ba, Msg::RAW ) );
+        m_burst = qMax( MIN_BURST_BLOCKS, m_burst / 2 );
+        return;
+    }
+
+    // the socket drained completely, it could take more at once
+    if ( queued == 0 )
+        m_burst = qMin( MAX_BURST_BLOCKS, m_burst * 2 );
+
+    const qint64 wanted = qMax( blockSize, qMin( m_burst * blockSize, MAX_QUEUED_BYTES - queued ) );
+    const qint64 granted = UploadThrottle::instance()->request( m_cc, wanted, blockSize );
+    if ( granted <= 0 )
+    {
+        // out of upload budget for now
+        if ( !m_throttled )
+        {
+            m_throttled = true;
+            QTimer::singleShot( THROTTLE_INTERVAL, this, SLOT( onThrottleTimeout() ) );
+        }
+
         return;
     }
-    else
+
+    if ( m_blockPool.isEmpty() )
+        m_blockPool.resize( BLOCK_POOL_SIZE );
+
+    for ( qint64 sent = 0; sent < granted; sent += blockSize )
     {
-        // more to come -> FRAGMENT
-        sendMsg( Msg::factory( ba, Msg::RAW | Msg::FRAGMENT ) );
+        // msgs get written out in order, so the oldest buffer is the one most likely to be free again
+        QByteArray& ba = m_blockPool[ m_poolPos ];
+        m_poolPos = ( m_poolPos + 1 ) % m_blockPool.count();
+        if ( !ba.isDetached() )
+            ba = QByteArray(); // still queued, leave it to its msg
+
+        // read straight into the msg's buffer, behind the "data" prefix
+        ba.resize( 4 + blockSize );
+        memcpy( ba.data(), "data", 4 );
+        const qint64 read = m_readdev->read( ba.data() + 4, blockSize );
+        ba.resize( 4 + qMax( (qint64)0, read ) );
+        m_bsent += ba.length() - 4;
+
+        if( m_readdev->atEnd() )
+        {
+            sendMsg( Msg::factory( ba, Msg::RAW ) );
+            return;
+        }
+        else
+        {
+            // more to come -> FRAGMENT
+            sendMsg( Msg::factory( ba, Msg::RAW | Msg::FRAGMENT ) );
+        }
     }
 
-    // HINT: change the 0 to 50 to transmit at 640Kbps, for example
-    //       (this is where upload throttling could be implemented)
+    // keep going while the socket has room, dataWritten wakes us up otherwise
     QTimer::singleShot( 0, this, SLOT( sendSome() ) );
 }
 
 
+void
+StreamConnection::onThrottleTimeout()
+{
+    m_throttled = false;
+    sendSome();
+}
+
+
 void
 StreamConnection::onBlockRequest( int block )
 {
@@ -22,6 +22,7 @@
 #include <QObject>
 #include <QSharedPointer>
 #include <QIODevice>
+#include <QVector>
 
 #include "network/connection.h"
 #include "result.h"
@@ -72,6 +73,7 @@ protected slots:
 private slots:
     void startSending( const Tomahawk::result_ptr& );
     void sendSome();
+    void onThrottleTimeout();
     void showStats( qint64 tx, qint64 rx );
 
     void onBlockRequest( int pos );
@@ -88,6 +90,13 @@ private:
     int m_badded, m_bsent;
     bool m_allok; // got last msg ok, transfer complete?
 
+    int m_burst; // blocks we send in one go
+    bool m_throttled;
+    bool m_throttleRegistered;
+
+    QVector<QByteArray> m_blockPool; // buffers for the data msgs we send, reused once they're written out
+    int m_poolPos;
+
     Tomahawk::source_ptr m_source;
     Tomahawk::result_ptr m_result;
     qint64 m_transferRate;
@@ -0,0 +1,144 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uploadthrottle.h"
+
+#include "tomahawksettings.h"
+#include "utils/logger.h"
+
+// how many seconds worth of budget a bucket can save up
+#define BURST_SECONDS 1
+// but at least this much, so even tiny limits let whole blocks through
+#define MIN_BURST ( 64 * 1024 )
+
+UploadThrottle* UploadThrottle::s_instance = 0;
+
+
+UploadThrottle*
+UploadThrottle::instance()
+{
+    if ( !s_instance )
+        s_instance = new UploadThrottle();
+
+    return s_instance;
+}
+
+
+UploadThrottle::UploadThrottle()
+{
+    m_total.tokens = 0;
+    m_total.senders = 0;
+    m_total.refilled.start();
+
+    TomahawkSettings* s = TomahawkSettings::instance();
+    setLimits( s->uploadLimit() * 1024, s->peerUploadLimit() * 1024 );
+}
+
+
+void
+UploadThrottle::setLimits( qint64 total, qint64 perPeer )
+{
+    QMutexLocker lock( &m_mutex );
+
+    tDebug() << Q_FUNC_INFO << "Upload limit:" << total << "bytes/s, per peer:" << perPeer << "bytes/s";
+    m_totalLimit = total;
+    m_peerLimit = perPeer;
+}
+
+
+void
+UploadThrottle::addSender( const void* peer )
+{
+    QMutexLocker lock( &m_mutex );
+
+    m_total.senders++;
+
+    if ( !m_peers.contains( peer ) )
+    {
+        Bucket b;
+        b.tokens = 0;
+        b.senders = 0;
+        b.refilled.start();
+        m_peers.insert( peer, b );
+    }
+    m_peers[ peer ].senders++;
+}
+
+
+void
+UploadThrottle::removeSender( const void* peer )
+{
+    QMutexLocker lock( &m_mutex );
+
+    m_total.senders = qMax( 0, m_total.senders - 1 );
+
+    if ( m_peers.contains( peer ) && --m_peers[ peer ].senders <= 0 )
+        m_peers.remove( peer );
+}
+
+
+void
+UploadThrottle::refill( Bucket& bucket, qint64 rate )
+{
+    const qint64 elapsed = bucket.refilled.restart();
+    bucket.tokens = qMin( bucket.tokens + rate * elapsed / 1000, qMax( rate * BURST_SECONDS, (qint64)MIN_BURST ) );
+}
+
+
+qint64
+UploadThrottle::share( const Bucket& bucket, qint64 unit )
+{
+    // an equal share for everyone, but never less than one unit if the bucket has it
+    const qint64 s = bucket.tokens / qMax( 1, bucket.senders );
+    if ( s < unit )
+        return bucket.tokens >= unit ? unit : 0;
+
+    return s;
+}
+
+
+qint64
+UploadThrottle::request( const void* peer, qint64 wanted, qint64 unit )
+{
+    Q_ASSERT( unit > 0 );
+    QMutexLocker lock( &m_mutex );
+
+    qint64 granted = wanted;
+
+    if ( m_totalLimit > 0 )
+    {
+        refill( m_total, m_totalLimit );
+        granted = qMin( granted, share( m_total, unit ) );
+    }
+
+    const bool limitPeer = ( m_peerLimit > 0 && m_peers.contains( peer ) );
+    if ( limitPeer )
+    {
+        refill( m_peers[ peer ], m_peerLimit );
+        granted = qMin( granted, share( m_peers[ peer ], unit ) );
+    }
+
+    granted -= granted % unit;
+
+    if ( m_totalLimit > 0 )
+        m_total.tokens -= granted;
+    if ( limitPeer )
+        m_peers[ peer ].tokens -= granted;
+
+    return granted;
+}
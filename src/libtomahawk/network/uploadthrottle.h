@@ -0,0 +1,70 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UPLOADTHROTTLE_H
+#define UPLOADTHROTTLE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QTime>
+
+/*
+    Token buckets for the upload bandwidth all StreamConnections share, plus
+    one bucket per peer. Senders ask for the bytes they'd like to send and
+    get granted what the budget allows. No sender gets more than its fair
+    share of the global budget, so serving several friends at once splits the
+    uplink evenly between them.
+
+    Limits are in bytes per second, 0 means unlimited.
+*/
+class UploadThrottle
+{
+public:
+    static UploadThrottle* instance();
+
+    void setLimits( qint64 total, qint64 perPeer );
+
+    void addSender( const void* peer );
+    void removeSender( const void* peer );
+
+    // how many of the wanted bytes the sender may send right now, in multiples of unit
+    qint64 request( const void* peer, qint64 wanted, qint64 unit );
+
+private:
+    UploadThrottle();
+
+    struct Bucket
+    {
+        qint64 tokens;
+        QTime refilled;
+        int senders;
+    };
+
+    static void refill( Bucket& bucket, qint64 rate );
+    static qint64 share( const Bucket& bucket, qint64 unit );
+
+    QMutex m_mutex;
+    qint64 m_totalLimit;
+    qint64 m_peerLimit;
+    Bucket m_total;
+    QHash< const void*, Bucket > m_peers;
+
+    static UploadThrottle* s_instance;
+};
+
+#endif // UPLOADTHROTTLE_H
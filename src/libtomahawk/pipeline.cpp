@@ -25,13 +25,24 @@
 #include "ExternalResolver.h"
 #include "resolvers/scriptresolver.h"
 #include "resolvers/qtscriptresolver.h"
+#include "tomahawksettings.h"
 
 #include "utils/logger.h"
 
+// queries a resolver starts out with working on at once, the limit adapts to its latency from there
 #define DEFAULT_CONCURRENT_QUERIES 4
-#define MAX_CONCURRENT_QUERIES 16
+#define MAX_CONCURRENT_QUERIES 32
+// upper bound for all queries in flight, no matter how many resolvers we have
+#define MAX_ACTIVE_QUERIES 64
+// answers slower than this times the average shrink the resolver's limit
+#define LATENCY_TOLERANCE 2.0
 #define CLEANUP_TIMEOUT 5 * 60 * 1000
 #define MINSCORE 0.5
+// resolvers answering faster than this on average are asked along with the current tier
+#define FAST_RESOLVER_LATENCY 200
+#define LATENCY_SMOOTHING 0.25
+// how many reported results stay looked up by rid even if nobody else holds them
+#define RID_CACHE_KEEPALIVE 4096
 
 using namespace Tomahawk;
 
@@ -47,12 +58,12 @@ Pipeline::instance()
 
 Pipeline::Pipeline( QObject* parent )
     : QObject( parent )
+    , m_rids( "rids", RID_CACHE_KEEPALIVE )
     , m_running( false )
 {
     s_instance = this;
 
-    m_maxConcurrentQueries = qBound( DEFAULT_CONCURRENT_QUERIES, QThread::idealThreadCount(), MAX_CONCURRENT_QUERIES );
-    tDebug() << Q_FUNC_INFO << "Using" << m_maxConcurrentQueries << "threads";
+    m_tierWidth = TomahawkSettings::instance()->resolverTierWidth();
 
     m_temporaryQueryTimer.setInterval( CLEANUP_TIMEOUT );
     connect( &m_temporaryQueryTimer, SIGNAL( timeout() ), SLOT( onTemporaryQueryTimer() ) );
@@ -80,7 +91,7 @@ Pipeline::databaseReady()
 void
 Pipeline::start()
 {
-    tDebug() << Q_FUNC_INFO << "Shunting this many pending queries:" << m_queries_pending.size();
+    tDebug() << Q_FUNC_INFO << "Shunting this many pending queries:" << m_pendingLane.count();
     m_running = true;
 
     shuntNext();
@@ -96,11 +107,96 @@ Pipeline::stop()
 
 void
 Pipeline::removeResolver( Resolver* r )
+{
+    QList< query_ptr > waiting;
+    {
+        QMutexLocker lock( &m_mut );
+
+        m_resolvers.removeAll( r );
+        m_resolverLatency.remove( r );
+        m_resolverLimit.remove( r );
+        m_resolverInFlight.remove( r );
+
+        QMap< QID, QHash< Resolver*, QTime > >::iterator it = m_qidsDispatched.begin();
+        for ( ; it != m_qidsDispatched.end(); ++it )
+        {
+            if ( it.value().remove( r ) )
+                waiting << m_qids.value( it.key() );
+        }
+
+        emit resolverRemoved( r );
+    }
+
+    // don't let a tier wait for a resolver that is gone
+    foreach ( const query_ptr& q, waiting )
+    {
+        if ( !q.isNull() )
+            decQIDState( q );
+    }
+}
+
+
+unsigned int
+Pipeline::resolverLatency( Resolver* r ) const
 {
     QMutexLocker lock( &m_mut );
+    return (unsigned int)m_resolverLatency.value( r );
+}
 
-    m_resolvers.removeAll( r );
-    emit resolverRemoved( r );
+
+void
+Pipeline::updateLatency( Resolver* r, unsigned int msecs, bool timedOut )
+{
+    // only call this with m_mut locked
+    const float average = m_resolverLatency.value( r );
+    if ( !m_resolverLatency.contains( r ) )
+        m_resolverLatency.insert( r, msecs );
+    else
+        m_resolverLatency[ r ] += LATENCY_SMOOTHING * ( (float)msecs - average );
+
+    if ( m_resolverInFlight.value( r ) > 0 )
+        m_resolverInFlight[ r ]--;
+
+    /*
+        Additive increase, multiplicative decrease: every timely answer grows the limit
+        by one per limit answers, a timeout halves it and a slow answer shrinks it a bit.
+    */
+    float limit = m_resolverLimit.value( r, DEFAULT_CONCURRENT_QUERIES );
+    if ( timedOut )
+        limit /= 2;
+    else if ( average > 0 && msecs > LATENCY_TOLERANCE * average )
+        limit *= 0.9;
+    else
+        limit += 1.0 / limit;
+
+    m_resolverLimit.insert( r, qBound( (float)1.0, limit, (float)MAX_CONCURRENT_QUERIES ) );
+}
+
+
+bool
+Pipeline::hasCapacity( const QList< Resolver* >& tier ) const
+{
+    // only call this with m_mut locked
+    foreach ( Resolver* r, tier )
+    {
+        if ( m_resolverInFlight.value( r ) >= (int)m_resolverLimit.value( r, DEFAULT_CONCURRENT_QUERIES ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+void
+Pipeline::releaseResolvers( const QID& qid )
+{
+    // only call this with m_mut locked. frees the slots of resolvers we stop waiting for
+    const QHash< Resolver*, QTime > pending = m_qidsDispatched.take( qid );
+    foreach ( Resolver* r, pending.keys() )
+    {
+        if ( m_resolverInFlight.value( r ) > 0 )
+            m_resolverInFlight[ r ]--;
+    }
 }
 
 
@@ -189,30 +285,78 @@ Pipeline::resolverForPath( const QString& scriptPath )
 void
 Pipeline::resolve( const QList<query_ptr>& qlist, bool prioritized, bool temporaryQuery )
 {
+    resolve( qlist, prioritized ? Visible : Background, temporaryQuery );
+}
+
+
+void
+Pipeline::resolve( const query_ptr& q, bool prioritized, bool temporaryQuery )
+{
+    resolve( q, prioritized ? Visible : Background, temporaryQuery );
+}
+
+
+void
+Pipeline::resolve( QID qid, bool prioritized, bool temporaryQuery )
+{
+    resolve( query( qid ), prioritized, temporaryQuery );
+}
+
+
+void
+Pipeline::resolve( const query_ptr& q, ResolvePriority priority, bool temporaryQuery )
+{
+    if ( q.isNull() )
+        return;
+
+    QList< query_ptr > qlist;
+    qlist << q;
+    resolve( qlist, priority, temporaryQuery );
+}
+
+
+void
+Pipeline::resolve( const QList<query_ptr>& qlist, ResolvePriority priority, bool temporaryQuery )
+{
+    Q_ASSERT( priority >= Interactive && priority < PriorityCount );
+
     {
         QMutexLocker lock( &m_mut );
 
+        // the most recent request is the most relevant one, except for background work
+        const bool prepend = ( priority != Background );
+        QList< query_ptr >& lane = m_queries_pending[ priority ];
+
         int i = 0;
         foreach( const query_ptr& q, qlist )
         {
             if ( q->resolvingFinished() )
                 continue;
-            if ( m_queries_pending.contains( q ) )
-                continue;
             if ( m_qidsState.contains( q->id() ) )
                 continue;
 
+            if ( m_pendingLane.contains( q->id() ) )
+            {
+                // already waiting, move it up if it was queued with a lower priority
+                const int oldLane = m_pendingLane.value( q->id() );
+                if ( oldLane <= priority )
+                    continue;
+
+                m_queries_pending[ oldLane ].removeOne( q );
+            }
+
             if ( !m_qids.contains( q->id() ) )
                 m_qids.insert( q->id(), q );
 
-            if ( prioritized )
-                m_queries_pending.insert( i++, q );
+            m_pendingLane.insert( q->id(), priority );
+            if ( prepend )
+                lane.insert( i++, q );
             else
-                m_queries_pending << q;
+                lane << q;
 
             if ( temporaryQuery )
             {
-                m_queries_temporary << q;
+                m_qids_temporary << q->id();
 
                 if ( m_temporaryQueryTimer.isActive() )
                     m_temporaryQueryTimer.stop();
@@ -226,26 +370,7 @@ Pipeline::resolve( const QList<query_ptr>& qlist, bool prioritized, bool tempora
 
 
 void
-Pipeline::resolve( const query_ptr& q, bool prioritized, bool temporaryQuery )
-{
-    if ( q.isNull() )
-        return;
-
-    QList< query_ptr > qlist;
-    qlist << q;
-    resolve( qlist, prioritized, temporaryQuery );
-}
-
-
-void
-Pipeline::resolve( QID qid, bool prioritized, bool temporaryQuery )
-{
-    resolve( query( qid ), prioritized, temporaryQuery );
-}
-
-
-void
-Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
+Pipeline::reportResults( QID qid, const QList< result_ptr >& results, Resolver* resolver )
 {
     if ( !m_running )
         return;
@@ -255,7 +380,24 @@ Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
         tDebug() << "Result arrived too late for:" << qid;
         return;
     }
-    const query_ptr& q = m_qids.value( qid );
+    const query_ptr q = m_qids.value( qid );
+
+    // results of a tier we already timed out on are still taken, but don't count for the current tier
+    bool tierResponse = true;
+    if ( resolver )
+    {
+        QMutexLocker lock( &m_mut );
+
+        QMap< QID, QHash< Resolver*, QTime > >::iterator it = m_qidsDispatched.find( qid );
+        if ( it != m_qidsDispatched.end() && it.value().contains( resolver ) )
+            updateLatency( resolver, it.value().take( resolver ).elapsed() );
+        else
+            tierResponse = false;
+    }
+
+    // the resolver may have a free slot again
+    if ( tierResponse && resolver )
+        shuntNext();
 
     QList< result_ptr > cleanResults;
     foreach( const result_ptr& r, results )
@@ -275,15 +417,18 @@ Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
         {
             m_rids.insert( r->id(), r );
         }
+    }
 
-        if ( q->playable() && !q->isFullTextQuery() )
-        {
-            setQIDState( q, 0 );
-            return;
-        }
+    // once it's playable, the resolvers we still wait for only matter if they rank above this one,
+    // anything else could at best add alternatives nobody picks over what we already have
+    if ( q->playable() && !q->isFullTextQuery() && !higherWeightPending( q, resolver ) )
+    {
+        setQIDState( q, 0 );
+        return;
     }
 
-    decQIDState( q );
+    if ( tierResponse )
+        decQIDState( q );
 }
 
 
@@ -357,22 +502,33 @@ Pipeline::shuntNext()
         QMutexLocker lock( &m_mut );
 
         rc = m_resolvers.count();
-        if ( m_queries_pending.isEmpty() )
+
+        int lane = Interactive;
+        while ( lane < PriorityCount && m_queries_pending[ lane ].isEmpty() )
+            lane++;
+
+        if ( lane == PriorityCount )
         {
             if ( m_qidsState.isEmpty() )
                 emit idle();
             return;
         }
 
-        // Check if we are ready to dispatch more queries
-        if ( m_qidsState.count() >= m_maxConcurrentQueries )
+        /*
+            Check if we are ready to dispatch more queries: the resolvers of the first tier need a
+            free slot. Interactive queries skip the line, the user is waiting for them.
+        */
+        q = m_queries_pending[ lane ].first();
+        if ( lane != Interactive &&
+           ( m_qidsState.count() >= MAX_ACTIVE_QUERIES || !hasCapacity( nextTier( q ) ) ) )
             return;
 
         /*
-            Since resolvers are async, we now dispatch to the highest weighted ones
-            and after timeout, dispatch to next highest etc, aborting when solved
+            Since resolvers are async, we now dispatch to the highest weighted tier
+            of resolvers and after timeout, dispatch to the next tier etc, aborting when solved
         */
-        q = m_queries_pending.takeFirst();
+        m_queries_pending[ lane ].removeFirst();
+        m_pendingLane.remove( q->id() );
         q->setCurrentResolver( 0 );
     }
 
@@ -381,16 +537,26 @@ Pipeline::shuntNext()
 
 
 void
-Pipeline::timeoutShunt( const query_ptr& q )
+Pipeline::timeoutShunt( const query_ptr& q, unsigned int tier )
 {
     if ( !m_running )
         return;
 
-    // are we still waiting for a timeout?
-    if ( m_qidsTimeout.contains( q->id() ) )
     {
-        decQIDState( q );
+        QMutexLocker lock( &m_mut );
+
+        // are we still waiting for this tier?
+        if ( !m_qidsTimeout.contains( q->id() ) || m_qidsTimeout.value( q->id() ) != tier )
+            return;
+
+        // whoever didn't answer in time gets the full wait accounted
+        QHash< Resolver*, QTime > pending = m_qidsDispatched.take( q->id() );
+        QHash< Resolver*, QTime >::const_iterator it = pending.constBegin();
+        for ( ; it != pending.constEnd(); ++it )
+            updateLatency( it.key(), it.value().elapsed(), true );
     }
+
+    tierFinished( q );
 }
 
 
@@ -400,55 +566,120 @@ Pipeline::shunt( const query_ptr& q )
     if ( !m_running )
         return;
 
-    Resolver* r = 0;
+    QList< Resolver* > tier;
     if ( !q->resolvingFinished() )
-        r = nextResolver( q );
+    {
+        QMutexLocker lock( &m_mut );
+        tier = nextTier( q );
+    }
 
-    if ( r )
+    if ( tier.isEmpty() )
     {
-        tLog( LOGVERBOSE ) << "Dispatching to resolver" << r->name() << q->toString() << q->solved() << q->id();
+        // we get here when all resolvers had their go, or if we disable a resolver while a query is resolving
+        setQIDState( q, 0 );
+        return;
+    }
 
-        q->setCurrentResolver( r );
-        r->resolve( q );
-        emit resolving( q );
+    unsigned int timeout = 0;
+    unsigned int tierId = 0;
+    {
+        QMutexLocker lock( &m_mut );
+
+        QHash< Resolver*, QTime >& dispatched = m_qidsDispatched[ q->id() ];
+        foreach ( Resolver* r, tier )
+        {
+            q->setCurrentResolver( r );
+            dispatched[ r ].start();
+            m_resolverInFlight[ r ]++;
 
-        m_qidsTimeout.insert( q->id(), true );
+            // a resolver without a timeout is waited for until it answers
+            if ( r->timeout() > 0 )
+                timeout = qMax( timeout, r->timeout() );
+        }
 
-        if ( r->timeout() > 0 )
-            new FuncTimeout( r->timeout(), boost::bind( &Pipeline::timeoutShunt, this, q ), this );
+        // the number of resolvers asked so far only ever grows, so it tells the tiers apart
+        tierId = q->resolvedBy().count();
+        m_qidsState.insert( q->id(), tier.count() );
+        if ( timeout > 0 )
+            m_qidsTimeout.insert( q->id(), tierId );
     }
-    else
+
+    foreach ( Resolver* r, tier )
     {
-        // we get here if we disable a resolver while a query is resolving
-        setQIDState( q, 0 );
-        return;
+        // resolvers may report synchronously and already solve the query
+        if ( q->resolvingFinished() )
+            break;
+
+        tLog( LOGVERBOSE ) << "Dispatching to resolver" << r->name() << q->toString() << q->solved() << q->id();
+        r->resolve( q );
     }
+    emit resolving( q );
+
+    if ( timeout > 0 )
+        new FuncTimeout( timeout, boost::bind( &Pipeline::timeoutShunt, this, q, tierId ), this );
 
     shuntNext();
 }
 
 
-Tomahawk::Resolver*
-Pipeline::nextResolver( const Tomahawk::query_ptr& query ) const
+QList< Tomahawk::Resolver* >
+Pipeline::nextTier( const Tomahawk::query_ptr& query ) const
 {
-    Resolver* newResolver = 0;
-
+    // only call this with m_mut locked
+    QList< Resolver* > candidates;
+    unsigned int topWeight = 0;
     foreach ( Resolver* r, m_resolvers )
     {
         if ( query->resolvedBy().contains( r ) )
             continue;
 
-        if ( !newResolver )
-        {
-            newResolver = r;
-            continue;
-        }
+        candidates << r;
+        topWeight = qMax( topWeight, r->weight() );
+    }
+
+    /*
+        Everything within m_tierWidth of the highest weight left is asked at once. Resolvers
+        that proved to answer fast join in too, they don't hold the query up for long.
+    */
+    QList< Resolver* > tier;
+    foreach ( Resolver* r, candidates )
+    {
+        const float latency = m_resolverLatency.value( r );
+        if ( r->weight() + m_tierWidth >= topWeight || ( latency > 0 && latency < FAST_RESOLVER_LATENCY ) )
+            tier << r;
+    }
+
+    return tier;
+}
+
 
-        if ( r->weight() > newResolver->weight() )
-            newResolver = r;
+bool
+Pipeline::higherWeightPending( const Tomahawk::query_ptr& query, Tomahawk::Resolver* r ) const
+{
+    if ( !r )
+        return false;
+
+    QMutexLocker lock( &m_mut );
+
+    const QHash< Resolver*, QTime > pending = m_qidsDispatched.value( query->id() );
+    foreach ( Resolver* p, pending.keys() )
+    {
+        if ( p->weight() > r->weight() )
+            return true;
     }
 
-    return newResolver;
+    return false;
+}
+
+
+void
+Pipeline::tierFinished( const Tomahawk::query_ptr& query )
+{
+    // a playable query is done, otherwise shunt() moves on to the next tier if there is one
+    if ( query->playable() && !query->isFullTextQuery() )
+        setQIDState( query, 0 );
+    else
+        setQIDState( query, 1 );
 }
 
 
@@ -459,6 +690,7 @@ Pipeline::setQIDState( const Tomahawk::query_ptr& query, int state )
 
     if ( m_qidsTimeout.contains( query->id() ) )
         m_qidsTimeout.remove( query->id() );
+    releaseResolvers( query->id() );
 
     if ( state > 0 )
     {
@@ -471,7 +703,7 @@ Pipeline::setQIDState( const Tomahawk::query_ptr& query, int state )
         m_qidsState.remove( query->id() );
         query->onResolvingFinished();
 
-        if ( !m_queries_temporary.contains( query ) )
+        if ( !m_qids_temporary.contains( query->id() ) )
             m_qids.remove( query->id() );
 
         new FuncTimeout( 0, boost::bind( &Pipeline::shuntNext, this ), this );
@@ -506,9 +738,15 @@ Pipeline::decQIDState( const Tomahawk::query_ptr& query )
             return 0;
 
         state = m_qidsState.value( query->id() ) - 1;
+        if ( state > 0 )
+        {
+            // still waiting for others of this tier
+            m_qidsState.insert( query->id(), state );
+            return state;
+        }
     }
 
-    setQIDState( query, state );
+    tierFinished( query );
     return state;
 }
 
@@ -520,9 +758,7 @@ Pipeline::onTemporaryQueryTimer()
     tDebug() << Q_FUNC_INFO;
     m_temporaryQueryTimer.stop();
 
-    for ( int i = m_queries_temporary.count() - 1; i >= 0; i-- )
-    {
-        query_ptr q = m_queries_temporary.takeAt( i );
-        m_qids.remove( q->id() );
-    }
+    foreach ( const QID& qid, m_qids_temporary )
+        m_qids.remove( qid );
+    m_qids_temporary.clear();
 }
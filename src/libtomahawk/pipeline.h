@@ -21,11 +21,16 @@
 
 #include "typedefs.h"
 #include "query.h"
+#include "result.h"
+#include "utils/interncache.h"
 
 #include <QObject>
+#include <QHash>
 #include <QList>
 #include <QMap>
 #include <QMutex>
+#include <QSet>
+#include <QTime>
 #include <QTimer>
 
 #include <boost/function.hpp>
@@ -43,15 +48,25 @@ class DLLEXPORT Pipeline : public QObject
 Q_OBJECT
 
 public:
+    // lanes pending queries wait in, a lane is only served once all lanes above it are empty
+    enum ResolvePriority
+    {
+        Interactive = 0, // the user explicitly asked for it, e.g. by clicking a track
+        Visible,         // shown on screen right now
+        Background,      // everything else, e.g. the rest of a freshly loaded playlist
+        PriorityCount
+    };
+
     static Pipeline* instance();
 
     explicit Pipeline( QObject* parent = 0 );
     virtual ~Pipeline();
 
-    unsigned int pendingQueryCount() const { return m_queries_pending.count(); }
+    unsigned int pendingQueryCount() const { return m_pendingLane.count(); }
     unsigned int activeQueryCount() const { return m_qidsState.count(); }
 
-    void reportResults( QID qid, const QList< result_ptr >& results );
+    // pass the reporting resolver along, so we know when its tier is done and how fast it answered
+    void reportResults( QID qid, const QList< result_ptr >& results, Tomahawk::Resolver* resolver = 0 );
     void reportAlbums( QID qid, const QList< album_ptr >& albums );
     void reportArtists( QID qid, const QList< artist_ptr >& artists );
 
@@ -65,12 +80,15 @@ public:
     void addResolver( Resolver* r );
     void removeResolver( Resolver* r );
 
+    // average time in ms a resolver took to report results, 0 if unknown
+    unsigned int resolverLatency( Resolver* r ) const;
+
     query_ptr query( const QID& qid ) const
     {
         return m_qids.value( qid );
     }
 
-    result_ptr result( const RID& rid ) const
+    result_ptr result( const RID& rid )
     {
         return m_rids.value( rid );
     }
@@ -79,6 +97,8 @@ public slots:
     void resolve( const query_ptr& q, bool prioritized = true, bool temporaryQuery = false );
     void resolve( const QList<query_ptr>& qlist, bool prioritized = true, bool temporaryQuery = false );
     void resolve( QID qid, bool prioritized = true, bool temporaryQuery = false );
+    void resolve( const query_ptr& q, Tomahawk::Pipeline::ResolvePriority priority, bool temporaryQuery = false );
+    void resolve( const QList<query_ptr>& qlist, Tomahawk::Pipeline::ResolvePriority priority, bool temporaryQuery = false );
 
     void start();
     void stop();
@@ -92,14 +112,19 @@ signals:
     void resolverRemoved( Resolver* );
 
 private slots:
-    void timeoutShunt( const query_ptr& q );
+    void timeoutShunt( const query_ptr& q, unsigned int tier );
     void shunt( const query_ptr& q );
     void shuntNext();
 
     void onTemporaryQueryTimer();
 
 private:
-    Tomahawk::Resolver* nextResolver( const Tomahawk::query_ptr& query ) const;
+    QList< Tomahawk::Resolver* > nextTier( const Tomahawk::query_ptr& query ) const;
+    void updateLatency( Tomahawk::Resolver* r, unsigned int msecs, bool timedOut = false );
+    bool hasCapacity( const QList< Tomahawk::Resolver* >& tier ) const;
+    void releaseResolvers( const QID& qid );
+    bool higherWeightPending( const Tomahawk::query_ptr& query, Tomahawk::Resolver* r ) const;
+    void tierFinished( const Tomahawk::query_ptr& query );
 
     void setQIDState( const Tomahawk::query_ptr& query, int state );
     int incQIDState( const Tomahawk::query_ptr& query );
@@ -108,19 +133,27 @@ private:
     QList< Resolver* > m_resolvers;
     QList< Tomahawk::ExternalResolver* > m_scriptResolvers;
     QList< ResolverFactoryFunc > m_resolverFactories;
-    QMap< QID, bool > m_qidsTimeout;
+    QMap< QID, unsigned int > m_qidsTimeout; // tier we are waiting to time out
     QMap< QID, unsigned int > m_qidsState;
+    // resolvers of the current tier we are still waiting for, with their dispatch time
+    QMap< QID, QHash< Resolver*, QTime > > m_qidsDispatched;
+    QHash< Resolver*, float > m_resolverLatency;
+    // how many queries a resolver may work on at once, adapted to its latency
+    QHash< Resolver*, float > m_resolverLimit;
+    QHash< Resolver*, int > m_resolverInFlight;
     QMap< QID, query_ptr > m_qids;
-    QMap< RID, result_ptr > m_rids;
+    // only keeps results alive for a while after they got reported
+    TomahawkUtils::InternCache< RID, Result > m_rids;
 
-    QMutex m_mut; // for m_qids, m_rids
+    mutable QMutex m_mut; // for m_qids and the tier state
 
     // store queries here until DB index is loaded, then shunt them all
-    QList< query_ptr > m_queries_pending;
+    QList< query_ptr > m_queries_pending[ PriorityCount ];
+    QHash< QID, int > m_pendingLane;
     // store temporary queries here and clean up after timeout threshold
-    QList< query_ptr > m_queries_temporary;
+    QSet< QID > m_qids_temporary;
 
-    int m_maxConcurrentQueries;
+    unsigned int m_tierWidth;
     bool m_running;
     QTimer m_temporaryQueryTimer;
 
@@ -475,7 +475,7 @@ Playlist::resolve()
         qlist << p->query();
     }
 
-    Pipeline::instance()->resolve( qlist );
+    Pipeline::instance()->resolve( qlist, Pipeline::Background );
 }
 
 
@@ -22,11 +22,17 @@
 #include "sourcelist.h"
 #include "utils/logger.h"
 
+// tracks we load from a collection at once
+#define PAGE_SIZE 500
+// fetch the next page once the current item is this close to the last loaded row
+#define PREFETCH_ROWS 50
+
 using namespace Tomahawk;
 
 
 CollectionFlatModel::CollectionFlatModel( QObject* parent )
     : TrackModel( parent )
+    , m_loadAll( false )
 {
 }
 
@@ -60,13 +66,9 @@ CollectionFlatModel::addCollection( const collection_ptr& collection, bool sendN
     if ( sendNotifications )
         emit loadingStarted();
 
-    DatabaseCommand_AllTracks* cmd = new DatabaseCommand_AllTracks( collection );
-    connect( cmd, SIGNAL( tracks( QList<Tomahawk::query_ptr>, QVariant ) ),
-                    SLOT( onTracksAdded( QList<Tomahawk::query_ptr> ) ), Qt::QueuedConnection );
-
-    Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
-
+    m_pagedCollections << collection;
     m_loadingCollections << collection.data();
+    fetchPage( collection, QVariant() );
 
     if ( collection->source()->isLocal() )
         setTitle( tr( "My Collection" ) );
@@ -95,6 +97,110 @@ CollectionFlatModel::addFilteredCollection( const collection_ptr& collection, un
 }
 
 
+void
+CollectionFlatModel::fetchPage( const collection_ptr& collection, const QVariant& position )
+{
+    if ( m_fetching.contains( collection.data() ) )
+        return;
+
+    DatabaseCommand_AllTracks* cmd = new DatabaseCommand_AllTracks( collection );
+    cmd->setLimit( PAGE_SIZE );
+    cmd->setPage( position );
+
+    connect( cmd, SIGNAL( page( Tomahawk::collection_ptr, QList<Tomahawk::query_ptr>, QVariant ) ),
+                    SLOT( onPageLoaded( Tomahawk::collection_ptr, QList<Tomahawk::query_ptr>, QVariant ) ), Qt::QueuedConnection );
+
+    m_fetching << collection.data();
+    m_nextPage.remove( collection.data() );
+    Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
+}
+
+
+bool
+CollectionFlatModel::canFetchMore( const QModelIndex& parent ) const
+{
+    if ( parent.isValid() )
+        return false;
+
+    return !m_nextPage.isEmpty();
+}
+
+
+void
+CollectionFlatModel::fetchMore( const QModelIndex& parent )
+{
+    if ( parent.isValid() )
+        return;
+
+    foreach ( const collection_ptr& collection, m_pagedCollections )
+    {
+        if ( m_nextPage.contains( collection.data() ) )
+            fetchPage( collection, m_nextPage.value( collection.data() ) );
+    }
+}
+
+
+void
+CollectionFlatModel::loadAll()
+{
+    if ( m_loadAll )
+        return;
+
+    // pages already on their way carry on in onPageLoaded
+    m_loadAll = true;
+    fetchMore( QModelIndex() );
+}
+
+
+void
+CollectionFlatModel::setCurrentItem( const QModelIndex& index )
+{
+    TrackModel::setCurrentItem( index );
+
+    // don't let playback run out of tracks at the end of what we loaded so far
+    if ( index.isValid() && index.row() >= rowCount( QModelIndex() ) - PREFETCH_ROWS && canFetchMore( QModelIndex() ) )
+        fetchMore( QModelIndex() );
+}
+
+
+void
+CollectionFlatModel::clear()
+{
+    // pages still on their way get dropped in onPageLoaded
+    m_pagedCollections.clear();
+    m_nextPage.clear();
+    m_fetching.clear();
+    m_loadAll = false;
+
+    TrackModel::clear();
+}
+
+
+void
+CollectionFlatModel::onPageLoaded( const Tomahawk::collection_ptr& collection, const QList<Tomahawk::query_ptr>& tracks, const QVariant& nextPosition )
+{
+    qDebug() << Q_FUNC_INFO << collection->name() << tracks.count() << rowCount( QModelIndex() );
+
+    m_fetching.remove( collection.data() );
+    if ( !m_pagedCollections.contains( collection ) )
+        return;
+
+    if ( nextPosition.isNull() )
+        m_pagedCollections.removeAll( collection );
+    else
+        m_nextPage.insert( collection.data(), nextPosition );
+
+    m_loadingCollections.removeAll( collection.data() );
+    append( tracks );
+
+    if ( m_loadAll && !nextPosition.isNull() )
+        fetchPage( collection, nextPosition );
+
+    if ( m_loadingCollections.isEmpty() )
+        emit loadingFinished();
+}
+
+
 void
 CollectionFlatModel::onTracksAdded( const QList<Tomahawk::query_ptr>& tracks )
 {
@@ -22,6 +22,7 @@
 #include <QAbstractItemModel>
 #include <QList>
 #include <QHash>
+#include <QSet>
 
 #include "typedefs.h"
 #include "trackmodel.h"
@@ -49,6 +50,16 @@ public:
     void addCollection( const Tomahawk::collection_ptr& collection, bool sendNotifications = true );
     void addFilteredCollection( const Tomahawk::collection_ptr& collection, unsigned int amount, DatabaseCommand_AllTracks::SortOrder order );
 
+    // collections are loaded page by page, as the view scrolls down
+    virtual bool canFetchMore( const QModelIndex& parent ) const;
+    virtual void fetchMore( const QModelIndex& parent );
+    // filtering and sorting by anything but artist need the whole collection
+    virtual void loadAll();
+
+public slots:
+    virtual void setCurrentItem( const QModelIndex& index );
+    virtual void clear();
+
 signals:
     void repeatModeChanged( Tomahawk::PlaylistInterface::RepeatMode mode );
     void shuffleModeChanged( bool enabled );
@@ -61,13 +72,24 @@ private slots:
     void onDataChanged();
 
     void onTracksAdded( const QList<Tomahawk::query_ptr>& tracks );
+    void onPageLoaded( const Tomahawk::collection_ptr& collection, const QList<Tomahawk::query_ptr>& tracks, const QVariant& nextPosition );
     void onTracksRemoved( const QList<Tomahawk::query_ptr>& tracks );
 
 private:
+    void fetchPage( const Tomahawk::collection_ptr& collection, const QVariant& position );
+
     QMap< Tomahawk::collection_ptr, QPair< int, int > > m_collectionRows;
     QList<Tomahawk::query_ptr> m_tracksToAdd;
     // just to keep track of what we are waiting to be loaded
     QList<Tomahawk::Collection*> m_loadingCollections;
+
+    // paged collections with more tracks to load, and where their next page starts
+    QList<Tomahawk::collection_ptr> m_pagedCollections;
+    QHash<Tomahawk::Collection*, QVariant> m_nextPage;
+    // pages requested but not loaded yet
+    QSet<Tomahawk::Collection*> m_fetching;
+    // keep fetching pages until everything is loaded
+    bool m_loadAll;
 };
 
 #endif // COLLECTIONFLATMODEL_H
@@ -524,7 +524,7 @@ TrackModel::ensureResolved()
         query_ptr query = itemFromIndex( index( i, 0, QModelIndex() ) )->query();
 
         if ( !query->resolvingFinished() )
-            Pipeline::instance()->resolve( query );
+            Pipeline::instance()->resolve( query, Pipeline::Background );
     }
 }
 
@@ -92,6 +92,8 @@ public:
     virtual bool shuffled() const { return false; }
 
     virtual void ensureResolved();
+    // models that only load their rows on demand (see CollectionFlatModel) load all of them
+    virtual void loadAll() {}
 
     TrackModelItem* itemFromIndex( const QModelIndex& index ) const;
     /// Returns a flat list of all tracks in this model
@@ -19,6 +19,8 @@
 #include "trackproxymodel.h"
 
 #include <QTreeView>
+#include <QtAlgorithms>
+#include <QtConcurrentRun>
 
 #include "trackproxymodelplaylistinterface.h"
 #include "artist.h"
@@ -26,16 +28,95 @@
 #include "query.h"
 #include "utils/logger.h"
 
+// models with at least this many rows get filtered on a worker thread
+#define FILTER_ASYNC_ROWS 20000
+
+
+static bool
+localeAwareLessThan( const QString& left, const QString& right )
+{
+    return QString::localeAwareCompare( left, right ) < 0;
+}
+
+
+static QStringList
+filterTerms( const QString& pattern )
+{
+    return pattern.toCaseFolded().split( " ", QString::SkipEmptyParts );
+}
+
+
+static bool
+matchesTerms( const QString& text, const QStringList& terms )
+{
+    foreach ( const QString& term, terms )
+    {
+        if ( !text.contains( term ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+// true if every row matching terms also matched previous, e.g. when the filter got extended
+static bool
+isNarrowing( const QStringList& previous, const QStringList& terms )
+{
+    foreach ( const QString& p, previous )
+    {
+        bool covered = false;
+        foreach ( const QString& term, terms )
+        {
+            if ( term.contains( p ) )
+            {
+                covered = true;
+                break;
+            }
+        }
+
+        if ( !covered )
+            return false;
+    }
+
+    return true;
+}
+
+
+/// This method is run by QtConcurrent for large models.
+/// When narrowing, only the rows set in candidates are looked at (plus the ones appended since)
+static QBitArray
+matchRows( const QVector< QString >& text, const QBitArray& candidates, bool narrow, const QStringList& terms )
+{
+    QBitArray matches( text.count() );
+    for ( int i = 0; i < text.count(); i++ )
+    {
+        if ( narrow && i < candidates.count() && !candidates.testBit( i ) )
+            continue;
+
+        if ( matchesTerms( text.at( i ), terms ) )
+            matches.setBit( i );
+    }
+
+    return matches;
+}
+
 
 TrackProxyModel::TrackProxyModel( QObject* parent )
     : QSortFilterProxyModel( parent )
     , m_model( 0 )
     , m_showOfflineResults( true )
+    , m_filterTextValid( false )
+    , m_rowGeneration( 0 )
+    , m_matchesValid( false )
+    , m_filteringGeneration( 0 )
 {
     setFilterCaseSensitivity( Qt::CaseInsensitive );
     setSortCaseSensitivity( Qt::CaseInsensitive );
     setDynamicSortFilter( true );
 
+    connect( &m_filterWatcher, SIGNAL( finished() ), SLOT( onFilterMatched() ) );
+
     setSourceTrackModel( 0 );
 }
 
@@ -52,11 +133,30 @@ TrackProxyModel::setSourceModel( QAbstractItemModel* model )
 void
 TrackProxyModel::setSourceTrackModel( TrackModel* sourceModel )
 {
+    if ( m_model )
+    {
+        disconnect( m_model, 0, this, SLOT( invalidateRowCaches() ) );
+        disconnect( m_model, 0, this, SLOT( onSourceRowsAboutToBeInserted( QModelIndex, int, int ) ) );
+        disconnect( m_model, 0, this, SLOT( onSourceDataChanged( QModelIndex, QModelIndex ) ) );
+    }
+
     m_model = sourceModel;
+    invalidateRowCaches();
 
     if ( m_model && m_model->metaObject()->indexOfSignal( "trackCountChanged(uint)" ) > -1 )
         connect( m_model, SIGNAL( trackCountChanged( unsigned int ) ), playlistInterface().data(), SIGNAL( sourceTrackCountChanged( unsigned int ) ) );
 
+    // connected before QSortFilterProxyModel does, so the keys are up to date by the time it re-sorts
+    if ( m_model )
+    {
+        connect( m_model, SIGNAL( rowsAboutToBeInserted( QModelIndex, int, int ) ), SLOT( onSourceRowsAboutToBeInserted( QModelIndex, int, int ) ) );
+        connect( m_model, SIGNAL( rowsAboutToBeRemoved( QModelIndex, int, int ) ), SLOT( invalidateRowCaches() ) );
+        connect( m_model, SIGNAL( rowsAboutToBeMoved( QModelIndex, int, int, QModelIndex, int ) ), SLOT( invalidateRowCaches() ) );
+        connect( m_model, SIGNAL( layoutAboutToBeChanged() ), SLOT( invalidateRowCaches() ) );
+        connect( m_model, SIGNAL( modelAboutToBeReset() ), SLOT( invalidateRowCaches() ) );
+        connect( m_model, SIGNAL( dataChanged( QModelIndex, QModelIndex ) ), SLOT( onSourceDataChanged( QModelIndex, QModelIndex ) ) );
+    }
+
     QSortFilterProxyModel::setSourceModel( m_model );
 }
 
@@ -79,34 +179,136 @@ TrackProxyModel::filterAcceptsRow( int sourceRow, const QModelIndex& sourceParen
     if ( !m_showOfflineResults && !r.isNull() && !r->isOnline() )
         return false;
 
-    if ( filterRegExp().isEmpty() )
+    if ( m_matchTerms.isEmpty() )
         return true;
 
-    QStringList sl = filterRegExp().pattern().split( " ", QString::SkipEmptyParts );
-    foreach( QString s, sl )
+    if ( m_matchesValid && !sourceParent.isValid() && sourceRow < m_matches.count() )
+        return m_matches.testBit( sourceRow );
+
+    // appended after we matched, or we lost track of the rows
+    return matchesTerms( sourceParent.isValid() ? QString() : filterText( sourceRow ), m_matchTerms );
+}
+
+
+QString
+TrackProxyModel::filterText( int row ) const
+{
+    TrackModelItem* item = m_model->itemFromIndex( m_model->index( row, 0, QModelIndex() ) );
+    if ( !item || item->query().isNull() )
+        return QString();
+
+    const Tomahawk::query_ptr& q = item->query();
+    QString text;
+    if ( q->numResults() )
     {
-        s = s.toLower();
-        if ( !r.isNull() )
-        {
-            if ( !r->artist()->name().toLower().contains( s ) &&
-                 !r->album()->name().toLower().contains( s ) &&
-                 !r->track().toLower().contains( s ) )
-            {
-                return false;
-            }
-        }
-        else
-        {
-            if ( !q->artist().toLower().contains( s ) &&
-                 !q->album().toLower().contains( s ) &&
-                 !q->track().toLower().contains( s ) )
-            {
-                return false;
-            }
-        }
+        const Tomahawk::result_ptr& r = q->results().first();
+        text = r->artist()->name() + '\t' + r->album()->name() + '\t' + r->track();
     }
+    else
+        text = q->artist() + '\t' + q->album() + '\t' + q->track();
 
-    return true;
+    return text.toCaseFolded();
+}
+
+
+void
+TrackProxyModel::ensureFilterText() const
+{
+    if ( !m_filterTextValid )
+    {
+        m_filterText.clear();
+        m_filterTextValid = true;
+    }
+
+    // only rows appended since the last time need their text
+    const int rows = m_model->rowCount( QModelIndex() );
+    const int first = m_filterText.count();
+    m_filterText.resize( rows );
+    for ( int i = first; i < rows; i++ )
+        m_filterText[ i ] = filterText( i );
+}
+
+
+void
+TrackProxyModel::setFilter( const QString& pattern )
+{
+    m_filter = pattern;
+
+    // a filter has to see every row, not just the ones loaded so far. They get matched as they come in
+    if ( m_model && !filterTerms( pattern ).isEmpty() )
+        m_model->loadAll();
+
+    // the running match picks up the latest pattern once it's done
+    if ( m_filterWatcher.isRunning() )
+        return;
+
+    startFiltering();
+}
+
+
+void
+TrackProxyModel::sort( int column, Qt::SortOrder order )
+{
+    // paged models load in artist order, anything else needs all rows to sort properly
+    if ( m_model && column >= 0 && !( column == TrackModel::Artist && order == Qt::AscendingOrder ) )
+        m_model->loadAll();
+
+    QSortFilterProxyModel::sort( column, order );
+}
+
+
+void
+TrackProxyModel::startFiltering()
+{
+    const QString pattern = m_filter;
+    const QStringList terms = filterTerms( pattern );
+    if ( terms.isEmpty() || !m_model )
+    {
+        applyFilter( pattern, terms, QBitArray() );
+        return;
+    }
+
+    ensureFilterText();
+
+    // when the filter got extended, only the rows that matched before can still match
+    const bool narrow = m_matchesValid && isNarrowing( m_matchTerms, terms );
+    const QBitArray candidates = narrow ? m_matches : QBitArray();
+
+    if ( m_filterText.count() < FILTER_ASYNC_ROWS )
+    {
+        applyFilter( pattern, terms, matchRows( m_filterText, candidates, narrow, terms ) );
+        return;
+    }
+
+    m_filteringPattern = pattern;
+    m_filteringTerms = terms;
+    m_filteringGeneration = m_rowGeneration;
+    m_filterWatcher.setFuture( QtConcurrent::run( &matchRows, m_filterText, candidates, narrow, terms ) );
+}
+
+
+void
+TrackProxyModel::onFilterMatched()
+{
+    const bool stale = ( m_filteringGeneration != m_rowGeneration );
+    if ( !stale )
+        applyFilter( m_filteringPattern, m_filteringTerms, m_filterWatcher.result() );
+
+    if ( stale || m_filter != m_filteringPattern )
+        startFiltering();
+}
+
+
+void
+TrackProxyModel::applyFilter( const QString& pattern, const QStringList& terms, const QBitArray& matches )
+{
+    m_matchTerms = terms;
+    m_matches = matches;
+    m_matchesValid = !terms.isEmpty();
+
+    // filterAcceptsRow() only looks the rows up in m_matches now
+    setFilterRegExp( pattern );
+    emitFilterChanged( pattern );
 }
 
 
@@ -156,121 +358,244 @@ TrackProxyModel::remove( const QList< QPersistentModelIndex >& indexes )
 }
 
 
-bool
-TrackProxyModel::lessThan( const QModelIndex& left, const QModelIndex& right ) const
+void
+TrackProxyModel::invalidateRowCaches()
 {
-    TrackModelItem* p1 = itemFromIndex( left );
-    TrackModelItem* p2 = itemFromIndex( right );
+    m_sortKeys.valid = false;
+    m_filterTextValid = false;
+    m_matchesValid = false;
+    m_rowGeneration++;
+}
 
-    if ( !p1 )
-        return true;
-    if ( !p2 )
-        return false;
 
-    const Tomahawk::query_ptr& q1 = p1->query();
-    const Tomahawk::query_ptr& q2 = p2->query();
-
-    QString artist1 = q1->artistSortname();
-    QString artist2 = q2->artistSortname();
-    QString album1 = q1->album();
-    QString album2 = q2->album();
-    QString track1 = q1->track();
-    QString track2 = q2->track();
-    unsigned int albumpos1 = 0, albumpos2 = 0;
-    unsigned int bitrate1 = 0, bitrate2 = 0;
-    unsigned int mtime1 = 0, mtime2 = 0;
-    unsigned int size1 = 0, size2 = 0;
-    qint64 id1 = 0, id2 = 0;
-
-    if ( q1->numResults() )
-    {
-        const Tomahawk::result_ptr& r = q1->results().at( 0 );
-        artist1 = r->artist()->sortname();
-        album1 = r->album()->name();
-        track1 = r->track();
-        albumpos1 = r->albumpos();
-        bitrate1 = r->bitrate();
-        mtime1 = r->modificationTime();
-        id1 = r->trackId();
-        size1 = r->size();
-    }
-    if ( q2->numResults() )
-    {
-        const Tomahawk::result_ptr& r = q2->results().at( 0 );
-        artist2 = r->artist()->sortname();
-        album2 = r->album()->name();
-        track2 = r->track();
-        albumpos2 = r->albumpos();
-        bitrate2 = r->bitrate();
-        mtime2 = r->modificationTime();
-        id2 = r->trackId();
-        size2 = r->size();
-    }
+void
+TrackProxyModel::onSourceRowsAboutToBeInserted( const QModelIndex& parent, int start, int end )
+{
+    Q_UNUSED( end );
 
-    // This makes it a stable sorter and prevents items from randomly jumping about.
-    if ( id1 == id2 )
+    // appended rows get their keys lazily, anything else shifts the rows we have keys for
+    if ( parent.isValid() || start < qMax( m_sortKeys.number.count(), m_filterText.count() ) )
+        invalidateRowCaches();
+}
+
+
+void
+TrackProxyModel::onSourceDataChanged( const QModelIndex& topLeft, const QModelIndex& bottomRight )
+{
+    if ( topLeft.parent().isValid() )
     {
-        id1 = (qint64)&q1;
-        id2 = (qint64)&q2;
+        invalidateRowCaches();
+        return;
     }
 
-    if ( left.column() == TrackModel::Artist ) // sort by artist
+    if ( m_filterTextValid )
     {
-        if ( artist1 == artist2 )
+        const int last = qMin( bottomRight.row(), m_filterText.count() - 1 );
+        for ( int row = topLeft.row(); row <= last; row++ )
         {
-            if ( album1 == album2 )
-            {
-                if ( albumpos1 == albumpos2 )
-                    return id1 < id2;
-
-                return albumpos1 < albumpos2;
-            }
-
-            return QString::localeAwareCompare( album1, album2 ) < 0;
+            m_filterText[ row ] = filterText( row );
+            if ( m_matchesValid && row < m_matches.count() )
+                m_matches.setBit( row, matchesTerms( m_filterText.at( row ), m_matchTerms ) );
         }
 
-        return QString::localeAwareCompare( artist1, artist2 ) < 0;
+        // a match running on a worker has the old text
+        if ( m_filterWatcher.isRunning() )
+            m_rowGeneration++;
     }
-    else if ( left.column() == TrackModel::Album ) // sort by album
+
+    if ( !m_sortKeys.valid )
+        return;
+
+    const int last = qMin( bottomRight.row(), m_sortKeys.number.count() - 1 );
+    for ( int row = topLeft.row(); row <= last; row++ )
     {
-        if ( album1 == album2 )
+        if ( !updateSortKey( row ) )
         {
-            if ( albumpos1 == albumpos2 )
-                return id1 < id2;
-
-            return albumpos1 < albumpos2;
+            m_sortKeys.valid = false;
+            return;
         }
-
-        return QString::localeAwareCompare( album1, album2 ) < 0;
     }
-    else if ( left.column() == TrackModel::Bitrate ) // sort by bitrate
+}
+
+
+void
+TrackProxyModel::sortFields( int row, int column, QString& primary, QString& secondary, uint& number, qint64& id ) const
+{
+    primary = QString();
+    secondary = QString();
+    number = 0;
+    id = 0;
+
+    TrackModelItem* item = m_model->itemFromIndex( m_model->index( row, 0, QModelIndex() ) );
+    if ( !item || item->query().isNull() )
+        return;
+
+    const Tomahawk::query_ptr& q = item->query();
+    QString artist = q->artistSortname();
+    QString album = q->album();
+    uint albumpos = 0, bitrate = 0, mtime = 0, size = 0;
+
+    if ( q->numResults() )
     {
-        if ( bitrate1 == bitrate2 )
-            return id1 < id2;
+        const Tomahawk::result_ptr& r = q->results().at( 0 );
+        artist = r->artist()->sortname();
+        album = r->album()->name();
+        albumpos = r->albumpos();
+        bitrate = r->bitrate();
+        mtime = r->modificationTime();
+        size = r->size();
+        id = r->trackId();
+    }
 
-        return bitrate1 < bitrate2;
+    switch ( column )
+    {
+        case TrackModel::Artist:
+            primary = artist;
+            secondary = album;
+            number = albumpos;
+            break;
+
+        case TrackModel::Album:
+            primary = album;
+            number = albumpos;
+            break;
+
+        case TrackModel::Bitrate:
+            number = bitrate;
+            break;
+
+        case TrackModel::Age:
+            number = mtime;
+            break;
+
+        case TrackModel::Filesize:
+            number = size;
+            break;
+
+        default:
+            primary = m_model->data( m_model->index( row, column, QModelIndex() ) ).toString();
+            break;
     }
-    else if ( left.column() == TrackModel::Age ) // sort by mtime
+}
+
+
+bool
+TrackProxyModel::updateSortKey( int row ) const
+{
+    QString primary, secondary;
+    uint number;
+    qint64 id;
+    sortFields( row, m_sortKeys.column, primary, secondary, number, id );
+
+    // a string we haven't ranked yet needs a full rebuild
+    QHash< QString, int >::const_iterator pit = m_sortKeys.ranks.constFind( primary );
+    QHash< QString, int >::const_iterator sit = m_sortKeys.ranks.constFind( secondary );
+    if ( pit == m_sortKeys.ranks.constEnd() || sit == m_sortKeys.ranks.constEnd() )
+        return false;
+
+    m_sortKeys.primary[ row ] = pit.value();
+    m_sortKeys.secondary[ row ] = sit.value();
+    m_sortKeys.number[ row ] = number;
+    m_sortKeys.id[ row ] = id;
+
+    return true;
+}
+
+
+void
+TrackProxyModel::buildSortKeys( int column ) const
+{
+    const int rows = m_model->rowCount( QModelIndex() );
+
+    QVector< QString > primaries( rows ), secondaries( rows );
+    m_sortKeys.column = column;
+    m_sortKeys.primary.resize( rows );
+    m_sortKeys.secondary.resize( rows );
+    m_sortKeys.number.resize( rows );
+    m_sortKeys.id.resize( rows );
+    m_sortKeys.ranks.clear();
+
+    for ( int row = 0; row < rows; row++ )
     {
-        if ( mtime1 == mtime2 )
-            return id1 < id2;
+        sortFields( row, column, primaries[ row ], secondaries[ row ], m_sortKeys.number[ row ], m_sortKeys.id[ row ] );
+        m_sortKeys.ranks.insert( primaries.at( row ), 0 );
+        m_sortKeys.ranks.insert( secondaries.at( row ), 0 );
+    }
+    m_sortKeys.ranks.insert( QString(), 0 );
+
+    // collate every distinct string just once
+    QStringList strings = m_sortKeys.ranks.keys();
+    qSort( strings.begin(), strings.end(), localeAwareLessThan );
+    for ( int i = 0; i < strings.count(); i++ )
+        m_sortKeys.ranks[ strings.at( i ) ] = i;
 
-        return mtime1 < mtime2;
+    for ( int row = 0; row < rows; row++ )
+    {
+        m_sortKeys.primary[ row ] = m_sortKeys.ranks.value( primaries.at( row ) );
+        m_sortKeys.secondary[ row ] = m_sortKeys.ranks.value( secondaries.at( row ) );
     }
-    else if ( left.column() == TrackModel::Filesize ) // sort by file size
+
+    m_sortKeys.valid = true;
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Built sort keys for" << rows << "rows and" << strings.count() << "strings";
+}
+
+
+void
+TrackProxyModel::ensureSortKeys( int column, int row ) const
+{
+    if ( !m_sortKeys.valid || m_sortKeys.column != column )
     {
-        if ( size1 == size2 )
-            return id1 < id2;
+        buildSortKeys( column );
+        return;
+    }
+
+    // rows appended since we built the keys
+    const int first = m_sortKeys.number.count();
+    if ( row < first )
+        return;
+
+    const int rows = m_model->rowCount( QModelIndex() );
+    m_sortKeys.primary.resize( rows );
+    m_sortKeys.secondary.resize( rows );
+    m_sortKeys.number.resize( rows );
+    m_sortKeys.id.resize( rows );
 
-        return size1 < size2;
+    for ( int i = first; i < rows; i++ )
+    {
+        if ( !updateSortKey( i ) )
+        {
+            buildSortKeys( column );
+            return;
+        }
     }
+}
+
+
+bool
+TrackProxyModel::lessThan( const QModelIndex& left, const QModelIndex& right ) const
+{
+    if ( !m_model || left.parent().isValid() || right.parent().isValid() )
+        return left.row() < right.row();
+
+    ensureSortKeys( left.column(), qMax( left.row(), right.row() ) );
 
-    const QString& lefts = sourceModel()->data( left ).toString();
-    const QString& rights = sourceModel()->data( right ).toString();
-    if ( lefts == rights )
-        return id1 < id2;
+    const int l = left.row();
+    const int r = right.row();
+    if ( qMax( l, r ) >= m_sortKeys.number.count() )
+        return l < r;
+
+    if ( m_sortKeys.primary.at( l ) != m_sortKeys.primary.at( r ) )
+        return m_sortKeys.primary.at( l ) < m_sortKeys.primary.at( r );
+    if ( m_sortKeys.secondary.at( l ) != m_sortKeys.secondary.at( r ) )
+        return m_sortKeys.secondary.at( l ) < m_sortKeys.secondary.at( r );
+    if ( m_sortKeys.number.at( l ) != m_sortKeys.number.at( r ) )
+        return m_sortKeys.number.at( l ) < m_sortKeys.number.at( r );
+
+    // This makes it a stable sorter and prevents items from randomly jumping about.
+    if ( m_sortKeys.id.at( l ) != m_sortKeys.id.at( r ) )
+        return m_sortKeys.id.at( l ) < m_sortKeys.id.at( r );
 
-    return QString::localeAwareCompare( lefts, rights ) < 0;
+    return l < r;
 }
 
 
@@ -20,6 +20,11 @@
 #define TRACKPROXYMODEL_H
 
 #include <QtGui/QSortFilterProxyModel>
+#include <QBitArray>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
 
 #include "playlistinterface.h"
 #include "playlist/trackmodel.h"
@@ -50,6 +55,13 @@ public:
 
     virtual void emitFilterChanged( const QString &pattern ) { emit filterChanged( pattern ); }
 
+    // the latest pattern passed to setFilter(), even if it isn't applied yet
+    QString filter() const { return m_filter; }
+    // large models get matched on a worker thread, filterChanged() is emitted once the filter is applied
+    void setFilter( const QString& pattern );
+
+    virtual void sort( int column, Qt::SortOrder order = Qt::AscendingOrder );
+
     virtual TrackModelItem* itemFromIndex( const QModelIndex& index ) const { return sourceModel()->itemFromIndex( index ); }
 
     virtual Tomahawk::playlistinterface_ptr playlistInterface();
@@ -64,6 +76,65 @@ protected:
     TrackModel* m_model;
     bool m_showOfflineResults;
     Tomahawk::playlistinterface_ptr m_playlistInterface;
+
+private slots:
+    void invalidateRowCaches();
+    void onSourceRowsAboutToBeInserted( const QModelIndex& parent, int start, int end );
+    void onSourceDataChanged( const QModelIndex& topLeft, const QModelIndex& bottomRight );
+    void onFilterMatched();
+
+private:
+    /*
+        Sort keys of every source row for the column we sort by, computed
+        once instead of on every comparison. Strings are replaced by their
+        rank in a locale aware ordering of all distinct strings, so lessThan()
+        only compares integers.
+    */
+    struct SortKeys
+    {
+        SortKeys() : column( -1 ), valid( false ) {}
+
+        int column;
+        bool valid;
+
+        // struct-of-arrays, indexed by source row
+        QVector< int > primary;
+        QVector< int > secondary;
+        QVector< uint > number;
+        QVector< qint64 > id;
+
+        // string -> collation rank
+        QHash< QString, int > ranks;
+    };
+
+    void ensureSortKeys( int column, int row ) const;
+    void buildSortKeys( int column ) const;
+    bool updateSortKey( int row ) const;
+    void sortFields( int row, int column, QString& primary, QString& secondary, uint& number, qint64& id ) const;
+
+    mutable SortKeys m_sortKeys;
+
+    void ensureFilterText() const;
+    QString filterText( int row ) const;
+    void startFiltering();
+    void applyFilter( const QString& pattern, const QStringList& terms, const QBitArray& matches );
+
+    // case folded artist, album and track of every source row
+    mutable QVector< QString > m_filterText;
+    mutable bool m_filterTextValid;
+    // bumped whenever source rows shift, so matches computed for the old rows get dropped
+    int m_rowGeneration;
+
+    QString m_filter;
+    // the applied filter: its terms and which source rows matched them
+    QStringList m_matchTerms;
+    QBitArray m_matches;
+    bool m_matchesValid;
+
+    QFutureWatcher< QBitArray > m_filterWatcher;
+    QString m_filteringPattern;
+    QStringList m_filteringTerms;
+    int m_filteringGeneration;
 };
 
 #endif // TRACKPROXYMODEL_H
@@ -32,6 +32,7 @@ TrackProxyModelPlaylistInterface::TrackProxyModelPlaylistInterface( TrackProxyMo
     , m_repeatMode( PlaylistInterface::NoRepeat )
     , m_shuffled( false )
 {
+    connect( proxyModel, SIGNAL( filterChanged( QString ) ), SLOT( onFilterChanged() ) );
 }
 
 
@@ -58,7 +59,7 @@ TrackProxyModelPlaylistInterface::trackCount() const
 QString
 TrackProxyModelPlaylistInterface::filter() const
 {
-    return ( m_proxyModel.isNull() ? QString() : m_proxyModel.data()->filterRegExp().pattern() );
+    return ( m_proxyModel.isNull() ? QString() : m_proxyModel.data()->filter() );
 }
 
 
@@ -68,9 +69,13 @@ TrackProxyModelPlaylistInterface::setFilter( const QString& pattern )
     if ( m_proxyModel.isNull() )
         return;
 
-    m_proxyModel.data()->setFilterRegExp( pattern );
-    m_proxyModel.data()->emitFilterChanged( pattern );
+    m_proxyModel.data()->setFilter( pattern );
+}
+
 
+void
+TrackProxyModelPlaylistInterface::onFilterChanged()
+{
     emit trackCountChanged( trackCount() );
 }
 
@@ -58,6 +58,9 @@ public slots:
     virtual void setRepeatMode( Tomahawk::PlaylistInterface::RepeatMode mode ) { m_repeatMode = mode; emit repeatModeChanged( mode ); }
     virtual void setShuffled( bool enabled ) { m_shuffled = enabled; emit shuffleModeChanged( enabled ); }
 
+private slots:
+    void onFilterChanged();
+
 protected:
     QWeakPointer< TrackProxyModel > m_proxyModel;
     RepeatMode m_repeatMode;
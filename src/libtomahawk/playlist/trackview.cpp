@@ -27,6 +27,7 @@
 #include "trackmodel.h"
 #include "trackproxymodel.h"
 #include "audio/audioengine.h"
+#include "pipeline.h"
 #include "context/ContextWidget.h"
 #include "widgets/overlaywidget.h"
 #include "dynamic/widgets/LoadingSpinner.h"
@@ -84,6 +85,12 @@ TrackView::TrackView( QWidget* parent )
     connect( this, SIGNAL( doubleClicked( QModelIndex ) ), SLOT( onItemActivated( QModelIndex ) ) );
     connect( this, SIGNAL( customContextMenuRequested( const QPoint& ) ), SLOT( onCustomContextMenu( const QPoint& ) ) );
     connect( m_contextMenu, SIGNAL( triggered( int ) ), SLOT( onMenuTriggered( int ) ) );
+
+    // once scrolling settles, whatever is on screen gets resolved ahead of the rest
+    m_resolveTimer.setInterval( 250 );
+    m_resolveTimer.setSingleShot( true );
+    connect( &m_resolveTimer, SIGNAL( timeout() ), SLOT( resolveVisibleItems() ) );
+    connect( verticalScrollBar(), SIGNAL( valueChanged( int ) ), &m_resolveTimer, SLOT( start() ) );
 }
 
 
@@ -139,6 +146,9 @@ TrackView::setTrackModel( TrackModel* model )
     connect( m_model, SIGNAL( loadingFinished() ), m_loadingSpinner, SLOT( fadeOut() ) );
 
     connect( m_proxyModel, SIGNAL( filterChanged( QString ) ), SLOT( onFilterChanged( QString ) ) );
+    connect( m_proxyModel, SIGNAL( rowsInserted( QModelIndex, int, int ) ), &m_resolveTimer, SLOT( start() ) );
+    connect( m_proxyModel, SIGNAL( layoutChanged() ), &m_resolveTimer, SLOT( start() ) );
+    connect( m_proxyModel, SIGNAL( modelReset() ), &m_resolveTimer, SLOT( start() ) );
 
     setAcceptDrops( true );
 
@@ -171,6 +181,30 @@ TrackView::currentChanged( const QModelIndex& current, const QModelIndex& previo
 }
 
 
+void
+TrackView::resolveVisibleItems()
+{
+    if ( !m_model || !m_proxyModel )
+        return;
+
+    QList< Tomahawk::query_ptr > queries;
+    const QRect viewRect = viewport()->rect();
+
+    QModelIndex idx = indexAt( viewRect.topLeft() );
+    while ( idx.isValid() && visualRect( idx ).top() <= viewRect.bottom() )
+    {
+        TrackModelItem* item = m_model->itemFromIndex( m_proxyModel->mapToSource( idx ) );
+        if ( item && !item->query().isNull() && !item->query()->resolvingFinished() )
+            queries << item->query();
+
+        idx = indexBelow( idx );
+    }
+
+    if ( !queries.isEmpty() )
+        Pipeline::instance()->resolve( queries, Pipeline::Visible );
+}
+
+
 void
 TrackView::onItemActivated( const QModelIndex& index )
 {
@@ -184,6 +218,11 @@ TrackView::onItemActivated( const QModelIndex& index )
         m_proxyModel->setCurrentIndex( index );
         AudioEngine::instance()->playItem( m_proxyModel->playlistInterface(), item->query()->results().first() );
     }
+    else if ( item && !item->query().isNull() && !item->query()->resolvingFinished() )
+    {
+        // don't let the track the user asked for wait behind the rest of the playlist
+        Pipeline::instance()->resolve( item->query(), Pipeline::Interactive );
+    }
 
     emit itemActivated( index );
 }
@@ -223,6 +262,7 @@ void
 TrackView::resizeEvent( QResizeEvent* event )
 {
     QTreeView::resizeEvent( event );
+    m_resolveTimer.start();
 
     int sortSection = m_header->sortIndicatorSection();
     Qt::SortOrder sortOrder = m_header->sortIndicatorOrder();
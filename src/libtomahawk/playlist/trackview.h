@@ -21,6 +21,7 @@
 
 #include <QtGui/QTreeView>
 #include <QtGui/QSortFilterProxyModel>
+#include <QTimer>
 
 #include "contextmenu.h"
 #include "playlistitemdelegate.h"
@@ -98,6 +99,8 @@ private slots:
 
     void onCustomContextMenu( const QPoint& pos );
 
+    void resolveVisibleItems();
+
 private:
     void updateHoverIndex( const QPoint& pos );
 
@@ -118,6 +121,8 @@ private:
     QModelIndex m_hoveredIndex;
     QModelIndex m_contextMenuIndex;
     Tomahawk::ContextMenu* m_contextMenu;
+
+    QTimer m_resolveTimer;
 };
 
 #endif // TRACKVIEW_H
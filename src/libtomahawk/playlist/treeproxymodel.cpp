@@ -347,11 +347,11 @@ TreeProxyModel::textForItem( TreeModelItem* item ) const
     }
     else if ( !item->album().isNull() )
     {
-        return DatabaseImpl::sortname( item->album()->name() );
+        return item->album()->sortname();
     }
     else if ( !item->result().isNull() )
     {
-        return DatabaseImpl::sortname( item->result()->track() );
+        return item->result()->trackSortname();
     }
     else if ( !item->query().isNull() )
     {
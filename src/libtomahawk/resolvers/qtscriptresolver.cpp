@@ -120,7 +120,7 @@ QtScriptResolverHelper::addTrackResults( const QVariantMap& results )
 
     QString qid = results.value("qid").toString();
 
-    Tomahawk::Pipeline::instance()->reportResults( qid, tracks );
+    Tomahawk::Pipeline::instance()->reportResults( qid, tracks, m_resolver );
 }
 
 
@@ -374,7 +374,7 @@ QtScriptResolver::resolve( const Tomahawk::query_ptr& query )
 
     QList< Tomahawk::result_ptr > results = parseResultVariantList( reslist );
 
-    Tomahawk::Pipeline::instance()->reportResults( qid, results );
+    Tomahawk::Pipeline::instance()->reportResults( qid, results, this );
 }
 
 
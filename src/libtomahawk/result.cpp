@@ -21,32 +21,31 @@
 #include "album.h"
 #include "collection.h"
 #include "database/database.h"
+#include "database/databaseimpl.h"
 #include "database/databasecommand_resolve.h"
 #include "database/databasecommand_alltracks.h"
 #include "database/databasecommand_addfiles.h"
 #include "database/databasecommand_loadsocialactions.h"
 
+#include "utils/interncache.h"
 #include "utils/logger.h"
 
+// how many of the most recently used results we keep around even if nobody else holds them
+#define RESULT_CACHE_KEEPALIVE 1024
+
 using namespace Tomahawk;
 
-static QHash< QString, QWeakPointer< Result > > s_results;
-static QMutex s_mutex;
+static TomahawkUtils::InternCache< QString, Result > s_results( "results", RESULT_CACHE_KEEPALIVE );
 
 
 Tomahawk::result_ptr
 Result::get( const QString& url )
 {
-    QMutexLocker lock( &s_mutex );
-    if ( s_results.contains( url ) )
-    {
-        return s_results.value( url );
-    }
+    result_ptr r = s_results.value( url );
+    if ( !r.isNull() )
+        return r;
 
-    result_ptr r = result_ptr( new Result( url ) );
-    s_results.insert( url, r );
-
-    return r;
+    return s_results.insert( url, result_ptr( new Result( url ) ) );
 }
 
 
@@ -68,11 +67,7 @@ Result::Result( const QString& url )
 
 Result::~Result()
 {
-    QMutexLocker lock( &s_mutex );
-    if ( s_results.contains( m_url ) )
-    {
-        s_results.remove( m_url );
-    }
+    // s_results sweeps out our entry by itself. removing it here could drop a newer result for the same url
 }
 
 
@@ -263,6 +258,14 @@ Result::setAlbum( const Tomahawk::album_ptr& album )
 }
 
 
+void
+Result::setTrack( const QString& track )
+{
+    m_track = track;
+    m_trackSortname = DatabaseImpl::sortname( track );
+}
+
+
 void
 Result::setCollection( const Tomahawk::collection_ptr& collection )
 {
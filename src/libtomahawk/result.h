@@ -70,6 +70,7 @@ public:
     Tomahawk::artist_ptr artist() const;
     Tomahawk::album_ptr album() const;
     QString track() const { return m_track; }
+    QString trackSortname() const { return m_trackSortname; }
     QString url() const { return m_url; }
     QString mimetype() const { return m_mimetype; }
     QString friendlySource() const;
@@ -91,7 +92,7 @@ public:
     void setFriendlySource( const QString& s ) { m_friendlySource = s; }
     void setArtist( const Tomahawk::artist_ptr& artist );
     void setAlbum( const Tomahawk::album_ptr& album );
-    void setTrack( const QString& track ) { m_track = track; }
+    void setTrack( const QString& track );
     void setMimetype( const QString& mimetype ) { m_mimetype = mimetype; }
     void setDuration( unsigned int duration ) { m_duration = duration; }
     void setBitrate( unsigned int bitrate ) { m_bitrate = bitrate; }
@@ -137,6 +138,7 @@ private:
     Tomahawk::artist_ptr m_artist;
     Tomahawk::album_ptr m_album;
     QString m_track;
+    QString m_trackSortname;
     QString m_url;
     QString m_mimetype;
     QString m_friendlySource;
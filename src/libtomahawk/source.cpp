@@ -24,9 +24,9 @@
 
 #include "network/controlconnection.h"
 #include "database/databasecommand_addsource.h"
+#include "database/databasecommand_applyops.h"
 #include "database/databasecommand_collectionstats.h"
 #include "database/databasecommand_sourceoffline.h"
-#include "database/databasecommand_updatesearchindex.h"
 #include "database/database.h"
 
 #include <QCoreApplication>
@@ -48,6 +48,8 @@ Source::Source( int id, const QString& username )
     , m_state( DBSyncConnection::UNKNOWN )
     , m_cc( 0 )
     , m_commandCount( 0 )
+    , m_applyingCommands( false )
+    , m_commandsCommitted( false )
     , m_avatar( 0 )
     , m_fancyAvatar( 0 )
 {
@@ -368,33 +370,38 @@ Source::executeCommands()
         return;
     }
 
-    if ( !m_cmds.isEmpty() )
+    if ( m_applyingCommands )
     {
-        QList< QSharedPointer<DatabaseCommand> > cmdGroup;
-        QSharedPointer<DatabaseCommand> cmd = m_cmds.takeFirst();
-        while ( cmd->groupable() )
+        m_applyingCommands = false;
+        if ( !m_commandsCommitted )
         {
-            cmdGroup << cmd;
-            if ( !m_cmds.isEmpty() && m_cmds.first()->groupable() && m_cmds.first()->commandname() == cmd->commandname() )
-                cmd = m_cmds.takeFirst();
-            else
-                break;
+            // The batch got rolled back, so lastop in the db still points at the last op we really have.
+            // Forget our in-memory guid (and anything queued after the failed ops) so the refetch
+            // falls back to the stored lastop and gets the same ops again. We're not synced until then.
+            tLog() << "Failed to apply ops for source" << id() << "- refetching them";
+            m_lastCmdGuid.clear();
+            m_cmds.clear();
+
+            emit commandsFailed();
+            return;
         }
+    }
 
-        // return here when the last command finished
-        connect( cmd.data(), SIGNAL( finished() ), SLOT( executeCommands() ) );
-
-        if ( cmdGroup.count() )
-        {
-            Database::instance()->enqueue( cmdGroup );
-        }
-        else
-        {
-            Database::instance()->enqueue( cmd );
-        }
+    if ( !m_cmds.isEmpty() )
+    {
+        // apply everything we got in one transaction, we return here once it's done
+        Tomahawk::source_ptr source = SourceList::instance()->get( id() );
+        DatabaseCommand_ApplyOps* cmd = new DatabaseCommand_ApplyOps( m_cmds, source );
+        m_cmds.clear();
+
+        m_applyingCommands = true;
+        m_commandsCommitted = false;
+        // committed() is only emitted if the transaction went through, and always before finished()
+        connect( cmd, SIGNAL( committed() ), SLOT( onCommandsCommitted() ) );
+        connect( cmd, SIGNAL( finished() ), SLOT( executeCommands() ) );
+        Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
 
-        int percentage = ( float( m_commandCount - m_cmds.count() ) / (float)m_commandCount ) * 100.0;
-        m_textStatus = tr( "Saving (%1%)" ).arg( percentage );
+        m_textStatus = tr( "Saving (%1 changes)" ).arg( m_commandCount );
         emit stateChanged();
     }
     else
@@ -415,6 +422,13 @@ Source::executeCommands()
 }
 
 
+void
+Source::onCommandsCommitted()
+{
+    m_commandsCommitted = true;
+}
+
+
 void
 Source::reportSocialAttributesChanged( DatabaseCommand_SocialAction* action )
 {
@@ -440,17 +454,11 @@ Source::reportSocialAttributesChanged( DatabaseCommand_SocialAction* action )
 void
 Source::updateTracks()
 {
-    {
-        DatabaseCommand* cmd = new DatabaseCommand_UpdateSearchIndex();
-        Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
-    }
-
-    {
-        // Re-calculate local db stats
-        DatabaseCommand_CollectionStats* cmd = new DatabaseCommand_CollectionStats( SourceList::instance()->get( id() ) );
-        connect( cmd, SIGNAL( done( QVariantMap ) ), SLOT( setStats( QVariantMap ) ), Qt::QueuedConnection );
-        Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
-    }
+    // The search index is kept up to date by the AddFiles / DeleteFiles commands themselves,
+    // we only need to re-calculate the db stats
+    DatabaseCommand_CollectionStats* cmd = new DatabaseCommand_CollectionStats( SourceList::instance()->get( id() ) );
+    connect( cmd, SIGNAL( done( QVariantMap ) ), SLOT( setStats( QVariantMap ) ), Qt::QueuedConnection );
+    Database::instance()->enqueue( QSharedPointer<DatabaseCommand>( cmd ) );
 }
 
 
@@ -105,6 +105,8 @@ signals:
 
     void stateChanged();
     void commandsFinished();
+    // applying the fetched ops failed, they need to be fetched again
+    void commandsFailed();
 
     void socialAttributesChanged( const QString& action );
 
@@ -129,6 +131,7 @@ private slots:
     void trackTimerFired();
 
     void executeCommands();
+    void onCommandsCommitted();
 
 private:
     void addCommand( const QSharedPointer<DatabaseCommand>& command );
@@ -155,6 +158,8 @@ private:
     ControlConnection* m_cc;
     QList< QSharedPointer<DatabaseCommand> > m_cmds;
     int m_commandCount;
+    bool m_applyingCommands;
+    bool m_commandsCommitted;
 
     QPixmap* m_avatar;
     mutable QPixmap* m_fancyAvatar;
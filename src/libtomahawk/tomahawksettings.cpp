@@ -29,7 +29,7 @@
 #include "database/databasecommand_updatesearchindex.h"
 #include "database/database.h"
 
-#define VERSION 5
+#define VERSION 6
 
 using namespace Tomahawk;
 
@@ -187,6 +187,10 @@ TomahawkSettings::doUpgrade( int oldVersion, int newVersion )
     {
         // 0.3.0 contained a bug which prevent indexing local files. Force a reindex.
         QTimer::singleShot( 0, this, SLOT( updateIndex() ) );
+    } else if ( oldVersion == 5 )
+    {
+        // The fuzzy index is updated incrementally now, which needs a key field on every document. Force a reindex.
+        QTimer::singleShot( 0, this, SLOT( updateIndex() ) );
     }
 }
 
@@ -282,6 +286,34 @@ TomahawkSettings::setWatchForChanges( bool watch )
 }
 
 
+bool
+TomahawkSettings::inMemorySearchIndex() const
+{
+    return value( "collection/inmemorysearchindex", false ).toBool();
+}
+
+
+void
+TomahawkSettings::setInMemorySearchIndex( bool enable )
+{
+    setValue( "collection/inmemorysearchindex", enable );
+}
+
+
+bool
+TomahawkSettings::fullTextSearchIndex() const
+{
+    return value( "collection/fulltextsearchindex", false ).toBool();
+}
+
+
+void
+TomahawkSettings::setFullTextSearchIndex( bool enable )
+{
+    setValue( "collection/fulltextsearchindex", enable );
+}
+
+
 bool
 TomahawkSettings::httpEnabled() const
 {
@@ -747,6 +779,34 @@ TomahawkSettings::setExternalPort(int externalPort)
 }
 
 
+uint
+TomahawkSettings::uploadLimit() const
+{
+    return value( "network/upload-limit", 0 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setUploadLimit( uint kbps )
+{
+    setValue( "network/upload-limit", kbps );
+}
+
+
+uint
+TomahawkSettings::peerUploadLimit() const
+{
+    return value( "network/peer-upload-limit", 0 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setPeerUploadLimit( uint kbps )
+{
+    setValue( "network/peer-upload-limit", kbps );
+}
+
+
 QString
 TomahawkSettings::lastFmPassword() const
 {
@@ -894,6 +954,20 @@ TomahawkSettings::setEnabledScriptResolvers( const QStringList& resolvers )
 }
 
 
+uint
+TomahawkSettings::resolverTierWidth() const
+{
+    return value( "script/resolvertierwidth", 10 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setResolverTierWidth( uint width )
+{
+    setValue( "script/resolvertierwidth", width );
+}
+
+
 QString
 TomahawkSettings::scriptDefaultPath() const
 {
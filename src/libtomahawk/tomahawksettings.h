@@ -53,6 +53,12 @@ public:
     bool watchForChanges() const;
     void setWatchForChanges( bool watch );
 
+    bool inMemorySearchIndex() const; /// false by default, only read at startup
+    void setInMemorySearchIndex( bool enable );
+
+    bool fullTextSearchIndex() const; /// false by default, only read at startup
+    void setFullTextSearchIndex( bool enable );
+
     bool acceptedLegalWarning() const;
     void setAcceptedLegalWarning( bool accept );
 
@@ -130,6 +136,11 @@ public:
     int externalPort() const;
     void setExternalPort( int externalPort );
 
+    uint uploadLimit() const; /// in KB/s for all streams we serve together, 0 (the default) is unlimited
+    void setUploadLimit( uint kbps );
+    uint peerUploadLimit() const; /// in KB/s for the streams we serve a single peer, 0 (the default) is unlimited
+    void setPeerUploadLimit( uint kbps );
+
     QString proxyHost() const;
     void setProxyHost( const QString &host );
 
@@ -187,6 +198,8 @@ public:
     void addScriptResolver( const QString& resolver );
     QStringList enabledScriptResolvers() const;
     void setEnabledScriptResolvers( const QStringList& resolvers );
+    uint resolverTierWidth() const; /// resolvers within this weight of each other are asked at once, 100 asks all. only read at startup
+    void setResolverTierWidth( uint width );
 
 
     QString scriptDefaultPath() const;
@@ -0,0 +1,192 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "editdistance.h"
+
+#include <QVarLengthArray>
+
+#include <string.h>
+
+// longest pattern the bit-parallel kernel handles, one bit per character
+#define MAX_BITPARALLEL_LENGTH 64
+
+
+static int
+rowDistance( const ushort* s, int n, const ushort* t, int m )
+{
+    QVarLengthArray< int, 256 > r0( m + 1 ), r1( m + 1 ), r2( m + 1 );
+    int* twoAgo = r0.data();
+    int* prev = r1.data();
+    int* cur = r2.data();
+
+    for ( int j = 0; j <= m; j++ )
+        prev[j] = j;
+
+    for ( int i = 1; i <= n; i++ )
+    {
+        const ushort s_i = s[i - 1];
+        cur[0] = i;
+
+        for ( int j = 1; j <= m; j++ )
+        {
+            const ushort t_j = t[j - 1];
+
+            int cell = prev[j - 1] + ( s_i == t_j ? 0 : 1 );
+            if ( cur[j - 1] + 1 < cell )
+                cell = cur[j - 1] + 1;
+            if ( prev[j] + 1 < cell )
+                cell = prev[j] + 1;
+
+            // a transposition only ever wins if both characters match crosswise
+            if ( i > 2 && j > 2 && s[i - 2] == t_j && s_i == t[j - 2] && twoAgo[j - 2] + 1 < cell )
+                cell = twoAgo[j - 2] + 1;
+
+            cur[j] = cell;
+        }
+
+        int* tmp = twoAgo;
+        twoAgo = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    return prev[m];
+}
+
+
+static int
+bitParallelDistance( const ushort* s, int n, const ushort* t, int m )
+{
+    // match masks: bit i is set if s[i] is that character
+    quint64 ascii[128];
+    memset( ascii, 0, sizeof( ascii ) );
+
+    ushort otherChars[ MAX_BITPARALLEL_LENGTH ];
+    quint64 otherMasks[ MAX_BITPARALLEL_LENGTH ];
+    int others = 0;
+
+    for ( int i = 0; i < n; i++ )
+    {
+        const quint64 bit = (quint64)1 << i;
+        if ( s[i] < 128 )
+        {
+            ascii[ s[i] ] |= bit;
+            continue;
+        }
+
+        int k = 0;
+        while ( k < others && otherChars[k] != s[i] )
+            k++;
+        if ( k == others )
+        {
+            otherChars[k] = s[i];
+            otherMasks[k] = 0;
+            others++;
+        }
+        otherMasks[k] |= bit;
+    }
+
+    const quint64 last = (quint64)1 << ( n - 1 );
+    quint64 vp = ( n == MAX_BITPARALLEL_LENGTH ) ? ~(quint64)0 : ( last << 1 ) - 1;
+    quint64 vn = 0;
+    quint64 d0 = 0;
+    quint64 pmPrev = 0;
+    int score = n;
+
+    // no transpositions involving the first two characters of s
+    const quint64 transMask = ~(quint64)3;
+
+    for ( int j = 0; j < m; j++ )
+    {
+        quint64 pm = 0;
+        const ushort c = t[j];
+        if ( c < 128 )
+        {
+            pm = ascii[c];
+        }
+        else
+        {
+            for ( int k = 0; k < others; k++ )
+            {
+                if ( otherChars[k] == c )
+                {
+                    pm = otherMasks[k];
+                    break;
+                }
+            }
+        }
+
+        // ... nor the first two characters of t
+        quint64 tr = 0;
+        if ( j >= 2 )
+            tr = ( ( ( ~d0 ) & pm ) << 1 ) & pmPrev & transMask;
+
+        d0 = ( ( ( pm & vp ) + vp ) ^ vp ) | pm | vn | tr;
+
+        quint64 hp = vn | ~( d0 | vp );
+        quint64 hn = vp & d0;
+
+        if ( hp & last )
+            score++;
+        else if ( hn & last )
+            score--;
+
+        hp = ( hp << 1 ) | 1;
+        hn = hn << 1;
+
+        vp = hn | ~( d0 | hp );
+        vn = hp & d0;
+        pmPrev = pm;
+    }
+
+    return score;
+}
+
+
+int
+TomahawkUtils::editDistance( const ushort* source, int n, const ushort* target, int m )
+{
+    if ( n == 0 )
+        return m;
+    if ( m == 0 )
+        return n;
+
+    // the distance is symmetric, so we can use the shorter string as the bit pattern
+    if ( n > m )
+    {
+        const ushort* ts = source;
+        source = target;
+        target = ts;
+
+        const int tn = n;
+        n = m;
+        m = tn;
+    }
+
+    if ( n > MAX_BITPARALLEL_LENGTH )
+        return rowDistance( source, n, target, m );
+
+    return bitParallelDistance( source, n, target, m );
+}
+
+
+int
+TomahawkUtils::editDistance( const QString& source, const QString& target )
+{
+    return editDistance( source.utf16(), source.length(), target.utf16(), target.length() );
+}
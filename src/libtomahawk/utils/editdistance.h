@@ -0,0 +1,42 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDITDISTANCE_H
+#define EDITDISTANCE_H
+
+#include <QString>
+
+#include "dllmacro.h"
+
+namespace TomahawkUtils
+{
+    /*
+        Levenshtein distance with transpositions (optimal string alignment),
+        except that the first two characters of either string can't be
+        transposed - that's what Query::levenshtein always computed, and
+        result scores must not change.
+
+        Strings of up to 64 characters are compared with Hyyrö's bit-parallel
+        algorithm, longer ones fall back to a dynamic programming pass over
+        three rolling rows. Neither touches the heap for sortname-sized input.
+    */
+    DLLEXPORT int editDistance( const QString& source, const QString& target );
+    DLLEXPORT int editDistance( const ushort* source, int n, const ushort* target, int m );
+}
+
+#endif // EDITDISTANCE_H
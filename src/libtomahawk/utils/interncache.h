@@ -0,0 +1,207 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Copyright 2010-2011, Christian Muehlhaeuser <muesli@tomahawk-player.org>
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERNCACHE_H
+#define INTERNCACHE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+#include <QWeakPointer>
+
+#include "utils/logger.h"
+
+// must be a power of two
+#define INTERNCACHE_STRIPES 16
+// don't bother sweeping out dead entries before a stripe has this many
+#define INTERNCACHE_MIN_SWEEP 64
+
+namespace TomahawkUtils
+{
+
+/*
+    Thread-safe intern table handing out one shared instance per key.
+
+    Entries are only referenced weakly, so an object goes away as soon as
+    nobody uses it anymore. A bounded ring of strong references keeps the
+    most recently used ones alive though, so objects that are looked up over
+    and over don't get recreated every time. Dead entries are swept out once
+    a stripe doubled in size since its last sweep.
+
+    Keys are spread over INTERNCACHE_STRIPES stripes with a lock each, so
+    lookups from different threads rarely contend.
+*/
+template< typename Key, typename T >
+class InternCache
+{
+public:
+    explicit InternCache( const char* name, int keepAlive )
+        : m_name( name )
+    {
+        for ( int i = 0; i < INTERNCACHE_STRIPES; i++ )
+        {
+            m_stripes[i].ring.resize( qMax( 1, keepAlive / INTERNCACHE_STRIPES ) );
+            m_stripes[i].ringPos = 0;
+            m_stripes[i].sweepAt = INTERNCACHE_MIN_SWEEP;
+        }
+    }
+
+    // the live instance for key, or a null pointer
+    QSharedPointer< T > value( const Key& key )
+    {
+        Stripe& s = stripe( key );
+        QSharedPointer< T > evicted; // released after unlocking, it might be the last reference
+        QMutexLocker lock( &s.mutex );
+
+        typename QHash< Key, QWeakPointer< T > >::const_iterator it = s.entries.constFind( key );
+        if ( it != s.entries.constEnd() )
+        {
+            QSharedPointer< T > p = it.value().toStrongRef();
+            if ( !p.isNull() )
+            {
+                m_hits.ref();
+                evicted = touch( s, p );
+                return p;
+            }
+        }
+
+        m_misses.ref();
+        return QSharedPointer< T >();
+    }
+
+    // caches p, unless another thread got an instance for key in first. returns the one to use
+    QSharedPointer< T > insert( const Key& key, const QSharedPointer< T >& p )
+    {
+        Stripe& s = stripe( key );
+        QSharedPointer< T > evicted;
+        QMutexLocker lock( &s.mutex );
+
+        QWeakPointer< T >& entry = s.entries[ key ];
+        QSharedPointer< T > existing = entry.toStrongRef();
+        if ( !existing.isNull() )
+        {
+            evicted = touch( s, existing );
+            return existing;
+        }
+
+        entry = p;
+        evicted = touch( s, p );
+
+        if ( s.entries.count() >= s.sweepAt )
+            sweep( s );
+
+        return p;
+    }
+
+    void remove( const Key& key )
+    {
+        Stripe& s = stripe( key );
+        QMutexLocker lock( &s.mutex );
+        s.entries.remove( key );
+    }
+
+    unsigned int hits() const { return (int)m_hits; }
+    unsigned int misses() const { return (int)m_misses; }
+
+    float hitRate() const
+    {
+        const unsigned int h = hits();
+        const unsigned int total = h + misses();
+        return total ? (float)h / total : 0.0;
+    }
+
+    // entries including the ones not swept out yet
+    unsigned int count() const
+    {
+        unsigned int c = 0;
+        for ( int i = 0; i < INTERNCACHE_STRIPES; i++ )
+        {
+            QMutexLocker lock( &m_stripes[i].mutex );
+            c += m_stripes[i].entries.count();
+        }
+
+        return c;
+    }
+
+    // what the table itself takes, not counting the cached objects
+    quint64 memoryUsage() const
+    {
+        quint64 bytes = 0;
+        for ( int i = 0; i < INTERNCACHE_STRIPES; i++ )
+        {
+            QMutexLocker lock( &m_stripes[i].mutex );
+            bytes += m_stripes[i].entries.capacity() * ( sizeof( Key ) + sizeof( QWeakPointer< T > ) + 2 * sizeof( void* ) );
+            bytes += m_stripes[i].ring.capacity() * sizeof( QSharedPointer< T > );
+        }
+
+        return bytes;
+    }
+
+private:
+    struct Stripe
+    {
+        mutable QMutex mutex;
+        QHash< Key, QWeakPointer< T > > entries;
+        QVector< QSharedPointer< T > > ring;
+        int ringPos;
+        int sweepAt;
+    };
+
+    Stripe& stripe( const Key& key )
+    {
+        return m_stripes[ qHash( key ) & ( INTERNCACHE_STRIPES - 1 ) ];
+    }
+
+    // keeps p alive for a while longer, returns the reference it pushed out of the ring
+    static QSharedPointer< T > touch( Stripe& s, const QSharedPointer< T >& p )
+    {
+        QSharedPointer< T > old = s.ring.at( s.ringPos );
+        s.ring[ s.ringPos ] = p;
+        s.ringPos = ( s.ringPos + 1 ) % s.ring.count();
+
+        return old;
+    }
+
+    void sweep( Stripe& s )
+    {
+        typename QHash< Key, QWeakPointer< T > >::iterator it = s.entries.begin();
+        while ( it != s.entries.end() )
+        {
+            if ( it.value().isNull() )
+                it = s.entries.erase( it );
+            else
+                ++it;
+        }
+
+        s.sweepAt = qMax( INTERNCACHE_MIN_SWEEP, 2 * s.entries.count() );
+
+        tDebug( LOGVERBOSE ) << "Intern cache" << m_name << "swept, stripe keeps" << s.entries.count() << "entries."
+                             << "Hit rate:" << hitRate() << "(" << hits() << "hits," << misses() << "misses )";
+    }
+
+    const char* m_name;
+    Stripe m_stripes[ INTERNCACHE_STRIPES ];
+    QAtomicInt m_hits;
+    QAtomicInt m_misses;
+};
+
+}
+
+#endif // INTERNCACHE_H
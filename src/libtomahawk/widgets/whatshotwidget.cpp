@@ -500,7 +500,7 @@ WhatsHotWidget::chartTracksLoaded( ChartDataLoader* loader, const QList< query_p
 
     if ( m_trackModels.contains( chartId ) )
     {
-        Pipeline::instance()->resolve( tracks );
+        Pipeline::instance()->resolve( tracks, Pipeline::Background );
         m_trackModels[ chartId ]->append( tracks );
     }
 
@@ -259,7 +259,8 @@ Api_v1::resolve( QxtWebRequestEvent* event )
         qid = uuid();
 
     query_ptr qry = Query::get( QUrl::fromPercentEncoding( event->url.queryItemValue( "artist" ).toUtf8() ), QUrl::fromPercentEncoding( event->url.queryItemValue( "track" ).toUtf8() ), QUrl::fromPercentEncoding( event->url.queryItemValue( "album" ).toUtf8() ), qid, false );
-    Pipeline::instance()->resolve( qry, true, true );
+    // web pages tend to send a whole list at once, that has to stay within the pipeline's limits
+    Pipeline::instance()->resolve( qry, Pipeline::Visible, true );
 
     QVariantMap r;
     r.insert( "qid", qid );